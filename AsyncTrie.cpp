@@ -0,0 +1,53 @@
+#include "AsyncTrie.h"
+
+
+AsyncTrie::AsyncTrie(std::shared_ptr<ConcurrentTrie> trie, int numThreads, ThreadPool* resumer) {
+    trie_ = trie;
+    if (resumer == NULL) {
+        ownResumer_.reset(new ThreadPool(1));
+        resumer = ownResumer_.get();
+    }
+    resumer_ = resumer;
+    executor_.reset(new ThreadPool(numThreads));
+}
+
+std::shared_ptr<ConcurrentTrie> AsyncTrie::trie() {
+    return trie_;
+}
+
+// Inserts the words. If any of them is invalid, none are inserted and the co_await throws std::invalid_argument.
+TrieAwaitable<void> AsyncTrie::insert(std::vector<std::string> words) {
+    std::shared_ptr<ConcurrentTrie> trie = trie_;
+    return TrieAwaitable<void>(executor_.get(), resumer_, [trie, words]() mutable {
+        trie->insert(&words);
+    });
+}
+
+// Removes the words. If any of them is invalid, none are removed and the co_await throws std::invalid_argument.
+TrieAwaitable<void> AsyncTrie::remove(std::vector<std::string> words) {
+    std::shared_ptr<ConcurrentTrie> trie = trie_;
+    return TrieAwaitable<void>(executor_.get(), resumer_, [trie, words]() mutable {
+        trie->remove(&words);
+    });
+}
+
+TrieAwaitable<std::vector<bool>> AsyncTrie::contains(std::vector<std::string> words) {
+    std::shared_ptr<ConcurrentTrie> trie = trie_;
+    return TrieAwaitable<std::vector<bool>>(executor_.get(), resumer_, [trie, words]() mutable {
+        return trie->contains(&words);
+    });
+}
+
+TrieAwaitable<int> AsyncTrie::countWithPrefix(std::string prefix) {
+    std::shared_ptr<ConcurrentTrie> trie = trie_;
+    return TrieAwaitable<int>(executor_.get(), resumer_, [trie, prefix]() {
+        return trie->countWithPrefix(prefix);
+    });
+}
+
+TrieAwaitable<std::vector<std::string>> AsyncTrie::getStringsWithPrefix(std::string prefix) {
+    std::shared_ptr<ConcurrentTrie> trie = trie_;
+    return TrieAwaitable<std::vector<std::string>>(executor_.get(), resumer_, [trie, prefix]() {
+        return trie->getStringsWithPrefix(prefix);
+    });
+}
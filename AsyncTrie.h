@@ -0,0 +1,127 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>  // std::exception_ptr
+#include <functional>  // std::function
+#include <memory>  // std::shared_ptr, std::unique_ptr
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ConcurrentTrie.h"
+#include "utils/thread_pool.h"
+
+
+// The result of an AsyncTrie operation, for a coroutine to co_await. Awaiting it suspends the coroutine and runs
+// the operation on the AsyncTrie's executor. Once the operation has finished, the coroutine's resumption is posted
+// to the AsyncTrie's resume executor, so the coroutine continues on one of its threads, never the executor's - a
+// coroutine that blocks on another operation after the co_await cannot stall the executor that has to run it.
+// The co_await returns the operation's result, or rethrows what it threw. Nothing is run until it is awaited.
+template <typename T>
+class TrieAwaitable {
+
+    private:
+        ThreadPool* executor_;
+        ThreadPool* resumer_;
+        std::function<T()> operation_;
+        std::optional<T> result_;
+        std::exception_ptr error_;
+
+    public:
+        TrieAwaitable(ThreadPool* executor, ThreadPool* resumer, std::function<T()> operation)
+            : executor_(executor), resumer_(resumer), operation_(std::move(operation)) {}
+
+        bool await_ready() {
+            return false;
+        }
+
+        // The awaitable lives in the suspended coroutine's frame, so it outlives the operation. It is not touched
+        // once the resumption has been posted, as the coroutine may already have moved on and destroyed it.
+        void await_suspend(std::coroutine_handle<> caller) {
+            executor_->submit([this, caller]() {
+                try {
+                    result_.emplace(operation_());
+                } catch (...) {
+                    error_ = std::current_exception();
+                }
+                resumer_->submit([caller]() {
+                    caller.resume();
+                });
+            });
+        }
+
+        T await_resume() {
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return std::move(*result_);
+        }
+};
+
+template <>
+class TrieAwaitable<void> {
+
+    private:
+        ThreadPool* executor_;
+        ThreadPool* resumer_;
+        std::function<void()> operation_;
+        std::exception_ptr error_;
+
+    public:
+        TrieAwaitable(ThreadPool* executor, ThreadPool* resumer, std::function<void()> operation)
+            : executor_(executor), resumer_(resumer), operation_(std::move(operation)) {}
+
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> caller) {
+            executor_->submit([this, caller]() {
+                try {
+                    operation_();
+                } catch (...) {
+                    error_ = std::current_exception();
+                }
+                resumer_->submit([caller]() {
+                    caller.resume();
+                });
+            });
+        }
+
+        void await_resume() {
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+        }
+};
+
+// A front end for coroutines, which returns awaitable versions of the ConcurrentTrie's bulk operations and
+// prefix queries instead of blocking the calling thread. The operations run on an executor owned by the
+// AsyncTrie, which has one thread by default - bulk operations are still spread over the trie's OpenMP threads,
+// but however many coroutines are waiting, the trie never has more than one OpenMP team working on it.
+// Coroutines are resumed on a separate resume executor: the caller's, if one is passed in, which must outlive the
+// AsyncTrie, or else one owned by the AsyncTrie with a single thread.
+// The awaitables take their arguments by value, so the caller does not have to keep them alive.
+class AsyncTrie {
+
+    private:
+        std::shared_ptr<ConcurrentTrie> trie_;
+        std::unique_ptr<ThreadPool> ownResumer_;
+        ThreadPool* resumer_;
+        // Declared last, so that it finishes its work, and posts its last resumptions, before the others go
+        std::unique_ptr<ThreadPool> executor_;
+
+    public:
+        AsyncTrie(std::shared_ptr<ConcurrentTrie> trie, int numThreads = 1, ThreadPool* resumer = NULL);
+
+        std::shared_ptr<ConcurrentTrie> trie();
+
+        // Basic operations
+        TrieAwaitable<void> insert(std::vector<std::string> words);
+        TrieAwaitable<void> remove(std::vector<std::string> words);
+        TrieAwaitable<std::vector<bool>> contains(std::vector<std::string> words);
+
+        // Prefix queries
+        TrieAwaitable<int> countWithPrefix(std::string prefix);
+        TrieAwaitable<std::vector<std::string>> getStringsWithPrefix(std::string prefix);
+};
@@ -1,141 +1,343 @@
 #include "ConcurrentTrie.h"
 
 
-ConcurrentNode::ConcurrentNode() {
-    for (int i = 0; i < NODE_SIZE; i++) {
-        children_[i] = NULL;
-    }
-    parent_ = NULL;
-    isEnd_ = false;
-    numChildren_ = 0;
-    omp_init_lock(&nodeLock_);
-}
-
 ConcurrentTrie::ConcurrentTrie() {
     root_ = std::make_shared<ConcurrentNode>();
+    epoch_ = 0;
+    omp_init_lock(&rootLock_);
     size_ = 0;
     rwLock_ = std::make_shared<FairReadersWriters>();
     asyncWriteLock_ = std::make_shared<FairReadersWriters>();
     omp_init_lock(&sizeLock_);
+    prefixRemovals_ = 0;
+    filter_ = NULL;
+    wal_ = NULL;
+    changes_ = NULL;
+    checkpointEvery_ = 0;
+    checkpointPending_ = false;
+    stopCheckpoints_ = false;
     
     // Best performance after testing
-    omp_set_num_threads(4);
+    context_ = std::make_shared<ExecutionContext>(4);
+}
+
+// Nobody else can be using the ConcurrentTrie any more, so its nodes are freed straight away, in parallel.
+// Nodes that a snapshot still shares are left to the snapshot.
+ConcurrentTrie::~ConcurrentTrie() {
+    if (checkpointThread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(checkpointRequestMutex_);
+            stopCheckpoints_ = true;
+        }
+        checkpointRequested_.notify_one();
+        checkpointThread_.join();
+    }
+
+    std::vector<std::shared_ptr<ConcurrentNode>> subtrees;
+    if (root_.use_count() == 1) {
+        for (int i = 0; i < NODE_SIZE; i++) {
+            if (root_->children_[i]) {
+                subtrees.push_back(std::move(root_->children_[i]));
+            }
+        }
+    }
+    root_ = NULL;
+    freeSubtrees(subtrees, context_->maxThreads());
+    omp_destroy_lock(&rootLock_);
+    omp_destroy_lock(&sizeLock_);
 }
 
 std::shared_ptr<ConcurrentTrie> ConcurrentTrie::createSharedPtr() {
     return shared_from_this();
 }
 
+// Sets the number of threads this ConcurrentTrie may use. Other tries, and the OpenMP setting of the caller,
+// are not affected.
 void ConcurrentTrie::setNumThreads(int numThreads) {
-    omp_set_num_threads(numThreads);
+    context_->setMaxThreads(numThreads);
 }
 
 void ConcurrentTrie::setMaxThreads() {
-    omp_set_num_threads(omp_get_max_threads());
+    context_->setMaxThreads(omp_get_max_threads());
 }
 
-int ConcurrentTrie::getIndexOfChar(char c) {
-    int idx = int(c);
-    if (idx < SMALLEST_CHAR || idx > LARGEST_CHAR) {
-        printf("Invalid character: %c\n", c);
+// Returns true if every character of key can be stored in the ConcurrentTrie.
+// Checking the whole key up front keeps the check out of the traversal, and rejects the key before any node is created.
+bool ConcurrentTrie::isValidKey(const char* key, size_t length) {
+    return isKeyInRange(key, length, SMALLEST_CHAR, LARGEST_CHAR);
+}
+
+// Plans a bulk operation on words: picks the number of threads from their total cost (see ExecutionContext), and
+// splits them into chunks of about grainSize bytes of work each (see utils/cost_chunks.h) for the threads to take
+// as they become free. A grainSize of 0 or less picks one that gives each thread a few chunks.
+BulkPlan ConcurrentTrie::planBulk(std::vector<std::string>* words, long long grainSize) {
+    BulkPlan plan;
+    plan.totalCost = 0;
+    for (int i = 0; i < words->size(); i++) {
+        plan.totalCost += keyCost((*words)[i]);
+    }
+    plan.numThreads = context_->threadsFor(plan.totalCost);
+    plan.chunks = chunkByCost(words->size(), [words](int i) { return keyCost((*words)[i]); }, grainSize, plan.numThreads);
+    return plan;
+}
+
+// Throws if any of words cannot be stored, so that bulk operations are rejected before anything is changed.
+void ConcurrentTrie::checkKeys(std::vector<std::string>* words, const BulkPlan& plan) {
+    const std::vector<int>& chunks = plan.chunks;
+    bool allValid = true;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(&&:allValid)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            allValid = allValid && isValidKey((*words)[i].data(), (*words)[i].length());
+        }
+    }
+    if (!allValid) {
         throw std::invalid_argument("Invalid character");
     }
-    return idx;
 }
 
 char ConcurrentTrie::getCharForIndex(int idx) {
     if (idx < SMALLEST_CHAR || idx > LARGEST_CHAR) {
-        printf("Invalid index: %d\n", idx);
         throw std::invalid_argument("Invalid index");
     }
     return char(idx);
 }
- 
-// Inserts a word into the ConcurrentTrie.
-// Returns true if the word is already in the ConcurrentTrie.
-void ConcurrentTrie::insert(std::string word) {
 
-    if (word.length() == 0) {
-        return;
+// Creates an empty node of the current epoch.
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::newNode(int selfIndex) {
+    std::shared_ptr<ConcurrentNode> node = std::make_shared<ConcurrentNode>();
+    node->selfIndex_ = selfIndex;
+    node->epoch_ = epoch_;
+    return node;
+}
+
+// Creates a copy of node in the current epoch. The copy shares its children with node.
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::copyNode(const std::shared_ptr<ConcurrentNode>& node) {
+    std::shared_ptr<ConcurrentNode> copy = newNode(node->selfIndex_);
+    for (int i = 0; i < NODE_SIZE; i++) {
+        copy->children_[i] = node->children_[i];
     }
+    copy->isEnd_ = node->isEnd_;
+    copy->numChildren_ = node->numChildren_;
+    copy->subtreeSize_ = int(node->subtreeSize_);
+    return copy;
+}
 
-    rwLock_->startWrite();
+// Returns the root, first replacing it with a copy if it may be shared with a snapshot.
+// Must be called by writers, with rwLock_ held for writing.
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::writableRoot() {
+    omp_set_lock(&rootLock_);
+        if (root_->epoch_ != epoch_) {
+            root_ = copyNode(root_);
+        }
+        std::shared_ptr<ConcurrentNode> root = root_;
+    omp_unset_lock(&rootLock_);
+    return root;
+}
 
-    int index;
-    std::shared_ptr<ConcurrentNode> cur = root_;
+// Returns child index of node, first replacing it with a copy if it may be shared with a snapshot.
+// If there is no such child, one is created if create is true, and NULL is returned otherwise.
+// NULL is also returned if node has been pruned by another writer since the caller reached it (see
+// TrieCore::writableChild()), in which case writers that add strings have to start again from the root.
+// node must itself have been returned by writableRoot() or writableChild(), and depth is its distance from the root.
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::writableChild(const std::shared_ptr<ConcurrentNode>& node, int depth, int index, bool create) {
+    WalkHooks hooks = {this, 0};
+    return TrieCore<ConcurrentPolicy>::writableChild(hooks, node, depth, index, create);
+}
 
-    for (int i = 0; i < word.length(); i++) {
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::WalkHooks::root() {
+    return trie->writableRoot();
+}
 
-        index = getIndexOfChar(word[i]);
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::WalkHooks::newNode(int selfIndex) {
+    return trie->newNode(selfIndex);
+}
 
-        // Lock access to this node
-        omp_set_lock(&cur->nodeLock_);
+// Nodes from an older epoch may be shared with a snapshot
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::WalkHooks::copyIfShared(const std::shared_ptr<ConcurrentNode>& node) {
+    return node->epoch_ != trie->epoch_ ? trie->copyNode(node) : NULL;
+}
 
-            if (!cur->children_[index]) {
+void ConcurrentTrie::WalkHooks::linkChanged(ConcurrentNode* node, int depth, int index) {
+    trie->jumpLinkChanged(node, depth, index);
+}
 
-                // Create new node and set other attributes
-                std::shared_ptr<ConcurrentNode> newNode = std::make_shared<ConcurrentNode>();
-                newNode->parent_ = cur;
-                newNode->selfIndex_ = index;
-                newNode->isEnd_ = false;
-                newNode->numChildren_ = 0;
-                for (int i = 0; i < NODE_SIZE; i++) {
-                    newNode->children_[i] = NULL;
-                }
+// The word goes into the filter before it can be found, so that the filter never hides it. It is logged under
+// its node's lock, so the log and the change stream order changes to a word the way they happened.
+void ConcurrentTrie::WalkHooks::adding(const char* key, size_t length) {
+    if (trie->filter_) {
+        trie->filter_->add(key, length);
+    }
+    if (trie->wal_) {
+        lsn = trie->wal_->append(WriteAheadLog::OP_INSERT, key, length);
+    }
+    if (trie->changes_) {
+        trie->changes_->record(CHANGE_INSERT, key, length, lsn);
+    }
+}
 
-                cur->children_[index] = newNode;
-                cur->numChildren_++;
-            }
+void ConcurrentTrie::WalkHooks::removing(const char* key, size_t length) {
+    if (trie->filter_) {
+        trie->filter_->remove(key, length);
+    }
+    if (trie->wal_) {
+        lsn = trie->wal_->append(WriteAheadLog::OP_REMOVE, key, length);
+    }
+    if (trie->changes_) {
+        trie->changes_->record(CHANGE_REMOVE, key, length, lsn);
+    }
+}
 
-        // Unlock access to this node
-        omp_unset_lock(&cur->nodeLock_);
+// Returns the node reached by the first two characters of key, or NULL if there is none, without going through
+// the root and first-level nodes. key must be valid and at least two characters long.
+// The entry is filled in if no reader has used it since it last changed. Writers only change entries while no
+// reader is active, and readers filling in the same entry all store the same node, so no lock is needed.
+ConcurrentNode* ConcurrentTrie::jumpTo(const char* key) {
+    int first = (unsigned char) key[0] - SMALLEST_CHAR;
+    int second = (unsigned char) key[1] - SMALLEST_CHAR;
+    JumpEntry& entry = jumpTable_[first * NODE_SIZE + second];
+    if (entry.known.load(std::memory_order_acquire)) {
+        return entry.node.load(std::memory_order_relaxed);
+    }
+    ConcurrentNode* node = root_->children_[first].get();
+    if (node) {
+        node = node->children_[second].get();
+    }
+    entry.node.store(node, std::memory_order_relaxed);
+    entry.known.store(true, std::memory_order_release);
+    return node;
+}
 
-        cur = cur->children_[index];
+// Called by writers once child index of node, which is at depth, has been linked, replaced or unlinked, to forget
+// the jump table entries that may now be stale. Only links from the root and first-level nodes have entries.
+void ConcurrentTrie::jumpLinkChanged(ConcurrentNode* node, int depth, int index) {
+    if (!jumpTable_ || depth > 1) {
+        return;
+    }
+    if (depth == 0) {
+        for (int i = 0; i < NODE_SIZE; i++) {  // Every entry that starts with this character
+            jumpTable_[index * NODE_SIZE + i].known.store(false, std::memory_order_relaxed);
+        }
+    } else {
+        jumpTable_[node->selfIndex_ * NODE_SIZE + index].known.store(false, std::memory_order_relaxed);
+    }
+}
+ 
+// Inserts a word into the ConcurrentTrie.
+// If durability is enabled, the insert has been logged and fsynced by the time this returns.
+void ConcurrentTrie::insert(std::string word) {
+    if (tryInsert(word) == STATUS_INVALID_KEY) {
+        throw std::invalid_argument("Invalid character");
+    }
+}
 
+// Inserts a word into the ConcurrentTrie, or returns STATUS_INVALID_KEY without changing anything.
+TrieStatus ConcurrentTrie::tryInsert(const std::string& word) {
+    if (!isValidKey(word.data(), word.length())) {
+        return STATUS_INVALID_KEY;
     }
+    rwLock_->startWrite();
+    long long lsn = insertWord(word.data(), word.length());
+    rwLock_->endWrite();
+    commitLog(lsn);
+    maybeCheckpoint();
+    return STATUS_OK;
+}
 
-    if (cur->isEnd_) {
-        rwLock_->endWrite();
-        return;
+// Inserts a word without waiting for its log record to become durable, and returns the record's LSN.
+// Must be called with rwLock_ held for writing.
+long long ConcurrentTrie::insertWord(const char* word, size_t length) {
+
+    if (length == 0) {
+        return 0;
     }
 
-    omp_set_lock(&cur->nodeLock_);
-        cur->isEnd_ = true;
-    omp_unset_lock(&cur->nodeLock_);
+    // Nodes from the root to the end of the word, whose subtree sizes change if the word is new. They are held by
+    // owning pointers, since a concurrent remove may unlink any of them but the last one once it has been passed.
+    // Kept between calls, so that bulk inserts do not allocate it once per word, but emptied before returning,
+    // so that it does not keep nodes alive.
+    static thread_local std::vector<std::shared_ptr<ConcurrentNode>> path;
+
+    int phase = walks_.enter();
+    long long lastLsn = 0;
+    bool redo = true;
+    while (redo) {
+
+        // If removeSubtrees() unlinked a subtree that the word was added to, the word went with it, and its
+        // log record may come after the removal's. It is added again from the root, so that the trie, the log
+        // and the change stream all end with it in.
+        long long removals = prefixRemovals_;
+        WalkHooks hooks = {this, 0};
+        bool added = TrieCore<ConcurrentPolicy>::insertKey(hooks, word, length, path);
+        lastLsn = std::max(lastLsn, hooks.lsn);
+        redo = false;
+        for (int i = 0; added && removals != prefixRemovals_ && i < path.size(); i++) {
+            path[i]->nodeLock_.lock();
+                redo = redo || path[i]->unlinked_;
+            path[i]->nodeLock_.unlock();
+        }
+        path.clear();
 
-    omp_set_lock(&sizeLock_);
-        size_++;
-    omp_unset_lock(&sizeLock_);
-    
-    rwLock_->endWrite();
+        if (added) {
+            omp_set_lock(&sizeLock_);
+                size_++;  // Taken off again with the subtree by removeSubtrees() if the word is added again
+            omp_unset_lock(&sizeLock_);
+        }
+    }
+    walks_.exit(phase);
+    return lastLsn;
 }
 
-// Inserts multiple words into the ConcurrentTrie.
-void ConcurrentTrie::insert(std::vector<std::string>* words) {
+// Inserts multiple words into the ConcurrentTrie. If any of them is invalid, none are inserted.
+// If durability is enabled, all of the inserts are made durable together by a single commit at the end.
+// Threads take about grainSize bytes of words at a time (see planBulk()).
+void ConcurrentTrie::insert(std::vector<std::string>* words, long long grainSize) {
+
+    BulkPlan plan = planBulk(words, grainSize);
+    const std::vector<int>& chunks = plan.chunks;
+    checkKeys(words, plan);
 
     rwLock_->startWrite();
 
-    #pragma omp parallel for
-    for (int i = 0; i < words->size(); i++) {
-        insert((*words)[i]);
+    double startTime = omp_get_wtime();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            lastLsn = std::max(lastLsn, insertWord((*words)[i].data(), (*words)[i].length()));
+        }
     }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
 
     rwLock_->endWrite();
+    commitLog(lastLsn);
+    maybeCheckpoint();
 }
 
 void ConcurrentTrie::insertAsyncHelper(std::shared_ptr<ConcurrentTrie> trie, std::vector<std::string>* words) {
    
-    #pragma omp parallel for
-    for (int i = 0; i < words->size(); i++) {
-        trie->insert((*words)[i]);
+    BulkPlan plan = trie->planBulk(words, 0);
+    const std::vector<int>& chunks = plan.chunks;
+    trie->rwLock_->startWrite();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            lastLsn = std::max(lastLsn, trie->insertWord((*words)[i].data(), (*words)[i].length()));
+        }
     }
+    trie->rwLock_->endWrite();
+    trie->commitLog(lastLsn);
 
     trie->asyncWriteLock_->endWrite();  // asyncWriteLock_->startWrite() was called by insertAsync()
+    trie->maybeCheckpoint();
 }
 
 void ConcurrentTrie::insertAsync(std::vector<std::string>* words) {
     // Calls insertAsyncHelper on a separate thread.
 
+    checkKeys(words, planBulk(words, 0));  // Here rather than in the helper, where nobody could catch the exception
+
     asyncWriteLock_->startWrite();  // Within insertAsyncHelper, asyncWriteLock_->endWrite() will be called
 
     // Pass shared pointer to this ConcurrentTrie to the helper function,
@@ -146,134 +348,217 @@ void ConcurrentTrie::insertAsync(std::vector<std::string>* words) {
     return;
 }
 
+// Inserts the words in a file, one per line, reading at most numWords lines (all of them if numWords <= 0).
+// The file is memory-mapped and split at line boundaries into one chunk per thread, and each thread inserts
+// the words in its chunk straight from the mapping, without copying them into strings first. The number of
+// threads is picked from the size of the file and its number of lines (see ExecutionContext).
+// Empty lines and lines with characters that cannot be stored are skipped. Returns the number of lines read, not
+// counting skipped ones.
+int ConcurrentTrie::insertFromFile(std::string filepath, int numWords) {
+
+    MappedFile file(filepath);
+    if (!file.isOpen()) {
+        throw std::invalid_argument("Cannot read " + filepath);
+    }
+    const char* data = file.data();
+    size_t size = lengthOfLines(data, file.size(), numWords);
+
+    long long totalCost = size + KEY_OVERHEAD * std::count(data, data + size, '\n');
+    int numChunks = context_->threadsFor(totalCost);
+    std::vector<size_t> offsets = splitAtLines(data, size, numChunks);
+
+    rwLock_->startWrite();  // Once for the whole file - insertWord() does not take it again
+
+    long long lastLsn = 0;
+    int numInserted = 0;
+    #pragma omp parallel for num_threads(numChunks) if(numChunks > 1) schedule(static, 1) reduction(max:lastLsn) reduction(+:numInserted)
+    for (int k = 0; k < numChunks; k++) {
+        forEachLine(data, offsets[k], offsets[k + 1], [&](const char* word, size_t length) {
+            if (length > 0 && isValidKey(word, length)) {
+                lastLsn = std::max(lastLsn, insertWord(word, length));
+                numInserted++;
+            }
+        });
+    }
+
+    rwLock_->endWrite();
+    commitLog(lastLsn);
+    maybeCheckpoint();
+    return numInserted;
+}
+
 // Returns true if word is present in the ConcurrentTrie.
 bool ConcurrentTrie::contains(std::string word) {
+    bool result;
+    if (tryContains(word, &result) == STATUS_INVALID_KEY) {
+        throw std::invalid_argument("Invalid character");
+    }
+    return result;
+}
 
-    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
-    rwLock_->startRead();
-
-    std::shared_ptr<ConcurrentNode> cur = root_;
-    int index;
- 
-    for (int i = 0; i < word.length(); i++) {
+// Sets result to whether word is present in the ConcurrentTrie, or returns STATUS_INVALID_KEY.
+TrieStatus ConcurrentTrie::tryContains(const std::string& word, bool* result) {
 
-        index = getIndexOfChar(word[i]);
+    if (!isValidKey(word.data(), word.length())) {
+        return STATUS_INVALID_KEY;
+    }
+    // Most absent strings are ruled out here, without taking any lock
+    if (filter_ && !filter_->mayContain(word.data(), word.length())) {
+        *result = false;
+        return STATUS_OK;
+    }
 
-        // Acquire lock on this node
-        omp_set_lock(&cur->nodeLock_);
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+    *result = containsWord(word.data(), word.length());
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return STATUS_OK;
+}
 
-        if (!cur->children_[index]) {
+// Returns true if word is present in the ConcurrentTrie. The word must already have been checked with isValidKey().
+// Must be called with asyncWriteLock_ and rwLock_ held for reading - readers exclude writers, so the nodes cannot be
+// freed while this walk is using them.
+bool ConcurrentTrie::containsWord(const char* word, size_t length) {
 
-            // Unlock access to this node
-            omp_unset_lock(&cur->nodeLock_);
-            
-            rwLock_->endRead();
-            asyncWriteLock_->endRead();
-            return false;  // If word was in the ConcurrentTrie, this would not have been NULL.
-        }
-        
-        omp_unset_lock(&cur->nodeLock_);
-        cur = cur->children_[index];
+    if (filter_ && !filter_->mayContain(word, length)) {
+        return false;
     }
-    
-    omp_set_lock(&cur->nodeLock_);
-    bool result = cur->isEnd_;
-    omp_unset_lock(&cur->nodeLock_);
-
 
-    rwLock_->endRead();
-    asyncWriteLock_->endRead();
-    return result;
+    ConcurrentNode* cur = root_.get();
+    int start = 0;
+    if (jumpTable_ && length >= 2) {
+        cur = jumpTo(word);  // Skips the root and the first-level node
+        start = 2;
+    }
+    return TrieCore<ConcurrentPolicy>::containsKey(cur, word + start, length - start);
 }
 
 // Checks if multiple words are present in the ConcurrentTrie.
 // Returns a vector of booleans, where each boolean corresponds to the word at the same index in the input vector.
 // The boolean is true if the word is present in the ConcurrentTrie.
-std::vector<bool> ConcurrentTrie::contains(std::vector<std::string>* words) {
+// Threads take about grainSize bytes of words at a time (see planBulk()).
+std::vector<bool> ConcurrentTrie::contains(std::vector<std::string>* words, long long grainSize) {
 
+    BulkPlan plan = planBulk(words, grainSize);
+    const std::vector<int>& chunks = plan.chunks;
+    checkKeys(words, plan);
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
     rwLock_->startRead();
-    bool results[words->size()];
-    #pragma omp parallel for
-    for (int i = 0; i < words->size(); i++) {
-        results[i] = contains((*words)[i]);
+    double startTime = omp_get_wtime();
+    std::vector<uint8_t> results(words->size());  // Bytes, since threads cannot write neighbouring bits of a vector<bool>
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            results[i] = containsWord((*words)[i].data(), (*words)[i].length());
+        }
     }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
     rwLock_->endRead();
-    return std::vector<bool>(results, results + words->size());
+    asyncWriteLock_->endRead();
+    return std::vector<bool>(results.begin(), results.end());
 
 }
 
 
 // Deletes a string from the ConcurrentTrie.
+// If durability is enabled, the removal has been logged and fsynced by the time this returns.
 void ConcurrentTrie::remove(std::string word) {
-
-    // There are a few possibilities:
-    // 1. The word is not in the ConcurrentTrie. Return false in this scenario.
-    // 2. The word is present. Unmark the end of the word (set as false).
-    // If the word is not a prefix of another word, we delete the node.
-    // If there exists another word that is a prefix of this word, we do not delete the word
-    // otherwise we keep going up the ConcurrentTrie, deleting nodes until we reach a node that has more than one child.
-
-    if (word.length() == 0) {
-        return;
+    if (tryRemove(word) == STATUS_INVALID_KEY) {
+        throw std::invalid_argument("Invalid character");
     }
+}
 
+// Deletes a string from the ConcurrentTrie, or returns STATUS_INVALID_KEY without changing anything.
+TrieStatus ConcurrentTrie::tryRemove(const std::string& word) {
+    if (!isValidKey(word.data(), word.length())) {
+        return STATUS_INVALID_KEY;
+    }
     rwLock_->startWrite();
+    long long lsn = removeWord(word.data(), word.length());
+    rwLock_->endWrite();
+    commitLog(lsn);
+    maybeCheckpoint();
+    return STATUS_OK;
+}
 
-    int index;
-    std::shared_ptr<ConcurrentNode> cur = root_;
+// Deletes a string without waiting for its log record to become durable, and returns the record's LSN.
+// Must be called with rwLock_ held for writing.
+long long ConcurrentTrie::removeWord(const char* word, size_t length) {
 
-    for (int i = 0; i < word.length(); i++) {
-        index = getIndexOfChar(word[i]);
-        if (!cur->children_[index]) {
-            rwLock_->endWrite();
-            return;  // Scenario 1
-        }
-        cur = cur->children_[index];
-    }
- 
-    if (!cur->isEnd_) {
-        rwLock_->endWrite();
-        return;  // Scenario 1
+    if (length == 0) {
+        return 0;
     }
 
-    omp_set_lock(&cur->nodeLock_);
-        cur->isEnd_ = false;
-    omp_unset_lock(&cur->nodeLock_);
+    // Nodes from the root to the end of the word, whose subtree sizes change if the word is removed.
+    // Owning pointers, and kept between calls but emptied before returning, as in insertWord().
+    static thread_local std::vector<std::shared_ptr<ConcurrentNode>> path;
 
-    omp_set_lock(&sizeLock_);
-        size_--;
-    omp_unset_lock(&sizeLock_);
+    int phase = walks_.enter();
+    WalkHooks hooks = {this, 0};
+    bool removed = TrieCore<ConcurrentPolicy>::removeKey(hooks, word, length, path);
+    path.clear();
 
-    possiblyDeleteNode(cur);
-    rwLock_->endWrite();
+    if (removed) {
+        omp_set_lock(&sizeLock_);
+            size_--;
+        omp_unset_lock(&sizeLock_);
+    }
+    walks_.exit(phase);
+    return hooks.lsn;
 }
 
-// Deletes multiple strings from the ConcurrentTrie.
-void ConcurrentTrie::remove(std::vector<std::string>* words) {
+// Deletes multiple strings from the ConcurrentTrie. If any of them is invalid, none are deleted.
+// If durability is enabled, all of the removals are made durable together by a single commit at the end.
+// Threads take about grainSize bytes of words at a time (see planBulk()).
+void ConcurrentTrie::remove(std::vector<std::string>* words, long long grainSize) {
+
+    BulkPlan plan = planBulk(words, grainSize);
+    const std::vector<int>& chunks = plan.chunks;
+    checkKeys(words, plan);
 
     rwLock_->startWrite();
 
-    #pragma omp parallel for
-    for (int i = 0; i < words->size(); i++) {
-        remove((*words)[i]);
+    double startTime = omp_get_wtime();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            lastLsn = std::max(lastLsn, removeWord((*words)[i].data(), (*words)[i].length()));
+        }
     }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
 
     rwLock_->endWrite();
+    commitLog(lastLsn);
+    maybeCheckpoint();
 }
 
 void ConcurrentTrie::removeAsyncHelper(std::shared_ptr<ConcurrentTrie> trie, std::vector<std::string>* words) {
    
-    #pragma omp parallel for
-    for (int i = 0; i < words->size(); i++) {
-        trie->remove((*words)[i]);
+    BulkPlan plan = trie->planBulk(words, 0);
+    const std::vector<int>& chunks = plan.chunks;
+    trie->rwLock_->startWrite();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            lastLsn = std::max(lastLsn, trie->removeWord((*words)[i].data(), (*words)[i].length()));
+        }
     }
+    trie->rwLock_->endWrite();
+    trie->commitLog(lastLsn);
 
     trie->asyncWriteLock_->endWrite();  // asyncWriteLock_->startWrite() was called by removeAsync()
+    trie->maybeCheckpoint();
 }
 
 void ConcurrentTrie::removeAsync(std::vector<std::string>* words) {
     // Calls removeAsyncHelper on a separate thread
 
+    checkKeys(words, planBulk(words, 0));  // Here rather than in the helper, where nobody could catch the exception
+
     asyncWriteLock_->startWrite();  // Within removeAsyncHelper, asyncWriteLock_->endWrite() will be called
 
     // Pass shared pointer to this ConcurrentTrie to the helper function,
@@ -284,104 +569,1579 @@ void ConcurrentTrie::removeAsync(std::vector<std::string>* words) {
     return;
 }
 
-// This method is called on the last node when a word is removed from the ConcurrentTrie.
-// If the word is not a prefix of another word, we delete the node.
-// Until we find a prefix of this word that exists in the set, we keep going up the ConcurrentTrie, deleting nodes.
-// For instance, if our set has "beta" and "be", and we remove "beta",
-// we want to remove the "a" node, and go up and remove the "t" node as well.
-void ConcurrentTrie::possiblyDeleteNode(std::shared_ptr<ConcurrentNode> node) {
+// Plans a bulk operation on packed keys, like planBulk(), but without storing the chunks: their boundaries are
+// found from offsets when they are handed out (see packedChunkStart() in utils/cost_chunks.h).
+PackedPlan ConcurrentTrie::planPacked(std::span<const size_t> offsets, long long grainSize, size_t align) {
+    PackedPlan plan;
+    plan.numKeys = offsets.empty() ? 0 : offsets.size() - 1;
+    plan.align = align;
+    plan.totalCost = plan.numKeys == 0 ? 0 : KEY_OVERHEAD * (long long) plan.numKeys + (long long) (offsets[plan.numKeys] - offsets[0]);
+    plan.numThreads = context_->threadsFor(plan.totalCost);
+    plan.grain = grainSize > 0 ? grainSize : std::max(1LL, plan.totalCost / (plan.numThreads * CHUNKS_PER_THREAD));
+
+    // No more chunks than keys, or most of them would be empty
+    plan.numChunks = std::min((long long) plan.numKeys, (plan.totalCost + plan.grain - 1) / plan.grain);
+    if (plan.numChunks > 0) {
+        plan.grain = (plan.totalCost + plan.numChunks - 1) / plan.numChunks;
+    }
+    return plan;
+}
 
-    if (node == root_) {  // We don't want to delete the root
-        return;
+// Returns the first key of chunk c of plan, or the number of keys for c == plan.numChunks.
+size_t ConcurrentTrie::packedChunkBegin(std::span<const size_t> offsets, const PackedPlan& plan, long long c) {
+    if (c >= plan.numChunks) {
+        return plan.numKeys;
     }
+    size_t start = packedChunkStart(offsets.data(), plan.numKeys, plan.grain, c);
+    return start - start % plan.align;
+}
 
-    if (node->numChildren_ > 0) {  // Word is a prefix of another word
-        return;
+// Throws if offsets do not describe keys inside data, or if any of the keys cannot be stored, so that bulk
+// operations are rejected before anything is changed.
+void ConcurrentTrie::checkPackedKeys(std::span<const char> data, std::span<const size_t> offsets, const PackedPlan& plan) {
+
+    // Checked first and in order, since finding the chunks relies on it
+    for (size_t i = 0; i < plan.numKeys; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw std::invalid_argument("Offsets out of order");
+        }
+    }
+    if (plan.numKeys > 0 && offsets[plan.numKeys] > data.size()) {
+        throw std::invalid_argument("Offsets past the end of the data");
     }
 
-    if (node->isEnd_) {  // Word exists in the ConcurrentTrie
-        return;
+    bool allValid = true;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(&&:allValid)
+    for (long long c = 0; c < plan.numChunks; c++) {
+        size_t end = packedChunkBegin(offsets, plan, c + 1);
+        for (size_t i = packedChunkBegin(offsets, plan, c); i < end; i++) {
+            allValid = allValid && isValidKey(data.data() + offsets[i], offsets[i + 1] - offsets[i]);
+        }
     }
+    if (!allValid) {
+        throw std::invalid_argument("Invalid character");
+    }
+}
 
-    // Node->numChildren == 0 && node->isEnd == false
-    
-    // Delete self
-    std::shared_ptr<ConcurrentNode> parent = node->parent_;
-    
-    omp_set_lock(&parent->nodeLock_);
-    parent->children_[node->selfIndex_] = NULL;  // This removes the reference to the current node from the parent
-    parent->numChildren_--;  // Decrement number of children of parent, since there are no more children with this next character
-    omp_unset_lock(&parent->nodeLock_);
+// Inserts the packed keys into the ConcurrentTrie. If any of them is invalid, none are inserted.
+// Like insert() on a vector, threads take about grainSize bytes of keys at a time, the locks are taken once for
+// the whole batch, and the inserts are made durable together.
+void ConcurrentTrie::insert(std::span<const char> data, std::span<const size_t> offsets, long long grainSize) {
 
-    possiblyDeleteNode(parent);
-}
+    PackedPlan plan = planPacked(offsets, grainSize, 1);
+    checkPackedKeys(data, offsets, plan);
 
+    rwLock_->startWrite();
 
-int ConcurrentTrie::size() {
-    return size_;
+    double startTime = omp_get_wtime();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (long long c = 0; c < plan.numChunks; c++) {
+        size_t end = packedChunkBegin(offsets, plan, c + 1);
+        for (size_t i = packedChunkBegin(offsets, plan, c); i < end; i++) {
+            lastLsn = std::max(lastLsn, insertWord(data.data() + offsets[i], offsets[i + 1] - offsets[i]));
+        }
+    }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
+
+    rwLock_->endWrite();
+    commitLog(lastLsn);
+    maybeCheckpoint();
 }
 
+// Removes the packed keys from the ConcurrentTrie. If any of them is invalid, none are removed.
+void ConcurrentTrie::remove(std::span<const char> data, std::span<const size_t> offsets, long long grainSize) {
 
-// Given a prefix, return all words in the ConcurrentTrie that strictly starts with that prefix.
-std::vector<std::string> ConcurrentTrie::getStringsWithPrefix(std::string prefix) {
+    PackedPlan plan = planPacked(offsets, grainSize, 1);
+    checkPackedKeys(data, offsets, plan);
 
-    // Find the node that corresponds to the prefix
-    std::shared_ptr<ConcurrentNode> cur = root_;
-    int index;
-    for (int i = 0; i < prefix.length(); i++) {
-        index = getIndexOfChar(prefix[i]);
-        if (!cur->children_[index]) {
-            return std::vector<std::string>();  // return empty vector
+    rwLock_->startWrite();
+
+    double startTime = omp_get_wtime();
+    long long lastLsn = 0;
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1) reduction(max:lastLsn)
+    for (long long c = 0; c < plan.numChunks; c++) {
+        size_t end = packedChunkBegin(offsets, plan, c + 1);
+        for (size_t i = packedChunkBegin(offsets, plan, c); i < end; i++) {
+            lastLsn = std::max(lastLsn, removeWord(data.data() + offsets[i], offsets[i + 1] - offsets[i]));
         }
-        cur = cur->children_[index];
     }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
 
-    return getAllStringsSortedHelper(cur, prefix);
+    rwLock_->endWrite();
+    commitLog(lastLsn);
+    maybeCheckpoint();
 }
 
+// Sets results[i] to 1 if the ith packed key is present in the ConcurrentTrie, 0 otherwise.
+void ConcurrentTrie::contains(std::span<const char> data, std::span<const size_t> offsets, std::span<uint8_t> results, long long grainSize) {
 
-// Returns all strings in the ConcurrentTrie, sorted alphabetically.
-std::vector<std::string> ConcurrentTrie::getAllStringsSorted() {
-    // In this sequential implementation, this returns the same thing as getStringsWithPrefix("")
-
-    return getAllStringsSortedHelper(root_, "");
+    PackedPlan plan = planPacked(offsets, grainSize, 1);
+    if (results.size() < plan.numKeys) {
+        throw std::invalid_argument("Fewer results than keys");
+    }
+    checkPackedKeys(data, offsets, plan);
 
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+    double startTime = omp_get_wtime();
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1)
+    for (long long c = 0; c < plan.numChunks; c++) {
+        size_t end = packedChunkBegin(offsets, plan, c + 1);
+        for (size_t i = packedChunkBegin(offsets, plan, c); i < end; i++) {
+            results[i] = containsWord(data.data() + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
 }
 
-// Helper function for getAllStringsSorted()
-std::vector<std::string> ConcurrentTrie::getAllStringsSortedHelper(std::shared_ptr<ConcurrentNode> node, std::string prefix) {
+// Sets bit i of bits (bit i % 64 of bits[i / 64]) if the ith packed key is present in the ConcurrentTrie, and clears
+// it otherwise. The other bits of the last word are left alone. Chunks start at multiples of 64 keys, so each word
+// of bits is written by a single thread.
+void ConcurrentTrie::contains(std::span<const char> data, std::span<const size_t> offsets, std::span<uint64_t> bits, long long grainSize) {
 
-    if (node == NULL) {
-        return std::vector<std::string>();
+    PackedPlan plan = planPacked(offsets, grainSize, 64);
+    if (bits.size() * 64 < plan.numKeys) {
+        throw std::invalid_argument("Fewer results than keys");
     }
+    checkPackedKeys(data, offsets, plan);
 
-    std::vector<std::string> words;
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+    double startTime = omp_get_wtime();
+    #pragma omp parallel for num_threads(plan.numThreads) if(plan.numThreads > 1) schedule(dynamic, 1)
+    for (long long c = 0; c < plan.numChunks; c++) {
+        size_t end = packedChunkBegin(offsets, plan, c + 1);
+        for (size_t i = packedChunkBegin(offsets, plan, c); i < end; i++) {
+            uint64_t bit = 1ULL << (i % 64);
+            if (containsWord(data.data() + offsets[i], offsets[i + 1] - offsets[i])) {
+                bits[i / 64] |= bit;
+            } else {
+                bits[i / 64] &= ~bit;
+            }
+        }
+    }
+    context_->record(plan.totalCost, plan.numThreads, omp_get_wtime() - startTime);
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+}
 
-    // Initialise a stack of (node, word)
-    std::stack<std::pair<std::shared_ptr<ConcurrentNode>, std::string>> stack;
-    stack.push(std::make_pair(node, prefix));
+// Removes every string that starts with prefix from the ConcurrentTrie, and returns how many were removed.
+// The subtree under prefix is unlinked from its parent in one step and the counters along prefix are
+// adjusted by its size, so this takes time proportional to the length of prefix however many strings
+// are removed, apart from waiting for the writers already inside it to finish. The unlinked nodes are freed
+// later on a background thread.
+int ConcurrentTrie::removePrefix(std::string prefix) {
 
-    std::pair<std::shared_ptr<ConcurrentNode>, std::string> curPairToEvaluate;
-    std::shared_ptr<ConcurrentNode> curNodeToEvaluate;
-    std::string curWordToEvaluate;
-    while (!stack.empty()) {
-        curPairToEvaluate = stack.top();
-        stack.pop();
-        curNodeToEvaluate = curPairToEvaluate.first;
-        curWordToEvaluate = curPairToEvaluate.second;
+    if (!isValidKey(prefix.data(), prefix.length())) {
+        throw std::invalid_argument("Invalid character");  // Before anything is changed
+    }
+    return removeSubtrees(prefix, false);
+}
+
+// Removes every string from the ConcurrentTrie. Unlike removePrefix(""), the nodes have been freed by the
+// time this returns - in parallel, a few subtrees per thread.
+void ConcurrentTrie::clear() {
+    removeSubtrees("", true);
+}
 
-        if (curNodeToEvaluate->isEnd_) {
-            words.push_back(curWordToEvaluate);  // We have a word
+// Unlinks the subtree under prefix (every subtree under the root if prefix is empty), and returns the number
+// of strings removed. The nodes are freed before returning if freeNow is true, and on a background thread otherwise.
+// prefix must already have been checked with isValidKey().
+// Other writers may be inside a subtree when it is unlinked. It is marked unlinked_, so that those that have not
+// added their string yet start again from the root, and it is only counted once every walk that was running has
+// finished, so that the strings the others did add are taken off size_ with it.
+int ConcurrentTrie::removeSubtrees(const std::string& prefix, bool freeNow) {
+
+    rwLock_->startWrite();
+    detachMutex_.lock();
+
+    // Find the node just above the prefix, remembering the path to it
+    std::shared_ptr<ConcurrentNode> cur = writableRoot();
+    std::vector<std::shared_ptr<ConcurrentNode>> path;
+    path.push_back(cur);
+    for (int i = 0; i + 1 < (int) prefix.length(); i++) {
+        int index = (unsigned char) prefix[i] - SMALLEST_CHAR;
+        cur = writableChild(cur, i, index, false);
+        if (!cur) {
+            detachMutex_.unlock();
+            rwLock_->endWrite();
+            return 0;  // No string starts with prefix
         }
+        path.push_back(cur);
+    }
 
-        for (int i = NODE_SIZE - 1; i >= 0; i--) {  // Iterate through all children
-            if (curNodeToEvaluate->children_[i]) {
-                curWordToEvaluate.push_back(getCharForIndex(i));
-                stack.push(std::make_pair(curNodeToEvaluate->children_[i], curWordToEvaluate));
-                curWordToEvaluate.pop_back();
+    // Unlink the subtree (or, for an empty prefix, every subtree under the root)
+    std::vector<std::shared_ptr<ConcurrentNode>> detached;
+    std::vector<std::string> detachedPrefixes;
+    long long lsn = 0;
+    cur->nodeLock_.lock();
+        for (int i = 0; i < NODE_SIZE; i++) {
+            if (!prefix.empty() && i != (unsigned char) prefix.back() - SMALLEST_CHAR) {
+                continue;
             }
+            std::shared_ptr<ConcurrentNode> child = cur->children_[i];
+            if (child) {
+                child->nodeLock_.lock();  // The parent's lock before the child's, as in TrieCore::tryUnlinkChild()
+                    child->unlinked_ = true;
+                child->nodeLock_.unlock();
+                detached.push_back(child);
+                detachedPrefixes.push_back(prefix.empty() ? std::string(1, getCharForIndex(i)) : prefix);
+                cur->children_[i] = NULL;
+                cur->numChildren_--;
+                jumpLinkChanged(cur.get(), path.size() - 1, i);
+            }
+        }
+        if (!detached.empty()) {
+            prefixRemovals_++;  // After the marks and before the log record (see insertWord())
+        }
+        if (!detached.empty() && wal_) {
+            lsn = wal_->append(WriteAheadLog::OP_REMOVE_PREFIX, prefix.data(), prefix.length());
+        }
+        if (!detached.empty() && changes_) {
+            changes_->record(CHANGE_REMOVE_PREFIX, prefix.data(), prefix.length(), lsn);
+        }
+    cur->nodeLock_.unlock();
+
+    if (detached.empty()) {
+        detachMutex_.unlock();
+        rwLock_->endWrite();
+        return 0;
+    }
+
+    // The walks still inside the subtrees count what they add to the nodes above them and to size_ as well
+    walks_.wait();
+    int removed = 0;
+    for (int i = 0; i < detached.size(); i++) {
+        removed += detached[i]->subtreeSize_;
+    }
+
+    for (int i = 0; i < path.size(); i++) {
+        path[i]->subtreeSize_ -= removed;
+    }
+
+    omp_set_lock(&sizeLock_);
+        size_ -= removed;
+    omp_unset_lock(&sizeLock_);
+
+    possiblyDeleteNode(path);  // The parent may now be an empty chain
+    detachMutex_.unlock();
+    rwLock_->endWrite();
+    commitLog(lsn);
+    maybeCheckpoint();
+
+    if (freeNow) {
+        reclaimSubtrees(filter_, context_, detached, detachedPrefixes);
+    } else {
+        std::thread reclaimThread(ConcurrentTrie::reclaimSubtrees, filter_, context_, detached, detachedPrefixes);
+        reclaimThread.detach();
+    }
+    return removed;
+}
+
+// Nothing can reach the subtrees any more, and every walk that was inside them has finished, so they are freed
+// without taking any lock of the trie.
+void ConcurrentTrie::reclaimSubtrees(std::shared_ptr<CountingBloomFilter> filter, std::shared_ptr<ExecutionContext> context,
+                                     std::vector<std::shared_ptr<ConcurrentNode>> subtrees, std::vector<std::string> prefixes) {
+
+    // Until this is done the removed strings only cost the filter some false positives
+    if (filter) {
+        for (int i = 0; i < subtrees.size(); i++) {
+            updateFilter(filter.get(), subtrees[i], prefixes[i], false);
+        }
+    }
+
+    freeSubtrees(subtrees, context->maxThreads());
+}
+
+// Frees the nodes of subtrees, which nobody else can reach any more. The nodes are freed one at a time rather
+// than through recursive destructors, so that long chains cannot overflow the stack, and the subtrees are
+// shared out between up to numThreads threads. Nodes that a snapshot still shares are left to the snapshot.
+void ConcurrentTrie::freeSubtrees(std::vector<std::shared_ptr<ConcurrentNode>>& subtrees, int numThreads) {
+
+    if (subtrees.empty()) {
+        return;  // Not worth starting the threads for, which matters to tries created and destroyed empty
+    }
+
+    #pragma omp parallel for num_threads(numThreads) if(numThreads > 1) schedule(dynamic)
+    for (int k = 0; k < subtrees.size(); k++) {
+        TrieCore<ConcurrentPolicy>::freeSubtree(std::move(subtrees[k]));
+    }
+    subtrees.clear();
+}
+
+// This method is called with the path to the last node when a word is removed from the ConcurrentTrie.
+// If the word is not a prefix of another word, we delete the node.
+// Until we find a prefix of this word that exists in the set, we keep going up the ConcurrentTrie, deleting nodes.
+// For instance, if our set has "beta" and "be", and we remove "beta",
+// we want to remove the "a" node, and go up and remove the "t" node as well.
+// The path is used to go up, since nodes shared with snapshots can have more than one parent.
+void ConcurrentTrie::possiblyDeleteNode(std::vector<std::shared_ptr<ConcurrentNode>>& path) {
+    TrieCore<ConcurrentPolicy>::pruneEmptyPath(path, [this](ConcurrentNode* parent, int depth, int index) {
+        jumpLinkChanged(parent, depth, index);
+    });
+}
+
+
+int ConcurrentTrie::size() {
+    return size_;
+}
+
+// Returns the number of strings in the ConcurrentTrie that start with prefix.
+// Every node keeps the number of strings below it, so only the prefix itself is walked.
+int ConcurrentTrie::countWithPrefix(std::string prefix) {
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    ConcurrentNode* cur = root_.get();
+    int count = 0;
+    int start = 0;
+    if (jumpTable_ && prefix.length() >= 2 && isValidKey(prefix.data(), 2)) {
+        cur = jumpTo(prefix.data());
+        start = 2;
+    }
+    for (int i = start; cur && i <= prefix.length(); i++) {
+        if (i == prefix.length()) {
+            count = cur->subtreeSize_;
+            break;
+        }
+        int index = int(prefix[i]);
+        if (index < SMALLEST_CHAR || index > LARGEST_CHAR || !cur->children_[index]) {
+            break;  // No string in the trie starts with prefix
+        }
+        cur = cur->children_[index].get();
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return count;
+}
+
+
+// Returns the strings k in the ConcurrentTrie with lo <= k < hi, sorted alphabetically, up to limit strings.
+// An empty hi means there is no upper bound, and a negative limit means there is no limit.
+// The walk starts at lo rather than at the root, and stops as soon as it reaches hi or the limit.
+std::vector<std::string> ConcurrentTrie::range(std::string lo, std::string hi, int limit) {
+
+    std::vector<std::string> results;
+    if (limit == 0) {
+        return results;
+    }
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::string prefix;
+    rangeHelper(root_, prefix, lo, hi, true, limit, results);
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return results;
+}
+
+// Helper function for range()
+bool ConcurrentTrie::rangeHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const std::string& lo, const std::string& hi,
+                                 bool boundedByLo, int limit, std::vector<std::string>& results) {
+
+    // Everything from here on in sorted order starts with prefix or comes after it
+    if (!hi.empty() && prefix >= hi) {
+        return false;
+    }
+
+    int depth = prefix.length();
+
+    // A proper prefix of lo is smaller than lo
+    if (node->isEnd_ && (!boundedByLo || depth == lo.length())) {
+        results.push_back(prefix);
+        if ((int) results.size() == limit) {
+            return false;
+        }
+    }
+
+    int firstChild = 0;
+    if (boundedByLo && depth < lo.length()) {
+        firstChild = (unsigned char) lo[depth];  // Children before lo's next character are smaller than lo
+    }
+
+    for (int i = firstChild; i < NODE_SIZE; i++) {
+        if (node->children_[i]) {
+            bool childBoundedByLo = boundedByLo && depth < lo.length() && i == firstChild;
+            prefix.push_back(getCharForIndex(i));
+            bool keepGoing = rangeHelper(node->children_[i], prefix, lo, hi, childBoundedByLo, limit, results);
+            prefix.pop_back();
+            if (!keepGoing) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Returns the number of strings in the ConcurrentTrie that are smaller than key.
+// At each node along key, the subtree sizes of the children before key's next character are added up,
+// so this takes time proportional to the length of key times the node size.
+int ConcurrentTrie::rank(std::string key) {
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::shared_ptr<ConcurrentNode> cur = root_;
+    int count = 0;
+    for (int i = 0; i < key.length(); i++) {
+        if (cur->isEnd_) {
+            count++;  // A proper prefix of key is smaller than key
+        }
+        int index = (unsigned char) key[i];
+        for (int j = 0; j < std::min(index, NODE_SIZE); j++) {
+            if (cur->children_[j]) {
+                count += cur->children_[j]->subtreeSize_;
+            }
+        }
+        if (index >= NODE_SIZE || !cur->children_[index]) {
+            break;
+        }
+        cur = cur->children_[index];
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return count;
+}
+
+// Returns the string at position i (starting from 0) of the ConcurrentTrie in sorted order.
+// Throws std::out_of_range if there is no such string.
+std::string ConcurrentTrie::select(int i) {
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    if (i < 0 || i >= root_->subtreeSize_) {
+        rwLock_->endRead();
+        asyncWriteLock_->endRead();
+        throw std::out_of_range("Index out of range");
+    }
+
+    // Skip over whole subtrees until the i-th string is inside the current node's subtree
+    std::shared_ptr<ConcurrentNode> cur = root_;
+    std::string key;
+    while (true) {
+        if (cur->isEnd_) {
+            if (i == 0) {
+                break;
+            }
+            i--;
+        }
+        for (int j = 0; j < NODE_SIZE; j++) {
+            if (!cur->children_[j]) {
+                continue;
+            }
+            int childSize = cur->children_[j]->subtreeSize_;
+            if (i < childSize) {
+                key.push_back(getCharForIndex(j));
+                cur = cur->children_[j];
+                break;
+            }
+            i -= childSize;
+        }
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return key;
+}
+
+
+// Adds every string in other to this ConcurrentTrie.
+// Both tries are walked in lockstep. Subtrees that only exist in other are copied over whole,
+// and the branches under the root are processed in parallel.
+void ConcurrentTrie::unionWith(ConcurrentTrie& other) {
+
+    if (&other == this) {
+        return;
+    }
+
+    lockForSetOperation(other);
+    int phase = walks_.enter();
+
+    std::shared_ptr<ConcurrentNode> root = writableRoot();
+    int numThreads = context_->threadsFor(KEY_OVERHEAD * (size_ + other.size_));
+    int added = 0;
+    long long removals = prefixRemovals_ - 1;
+    while (removals != prefixRemovals_) {  // Strings added to a subtree that removeSubtrees() unlinked are added again
+        removals = prefixRemovals_;
+        #pragma omp parallel for num_threads(numThreads) if(numThreads > 1) schedule(dynamic) reduction(+:added)
+        for (int i = 0; i < NODE_SIZE; i++) {
+            std::string prefix;
+            bool pruned = true;
+            while (pruned) {  // Strings that are already in are not added twice, so the child can be merged again
+                pruned = false;
+                added += unionChild(root, other.root_, i, prefix, &pruned);
+            }
+        }
+    }
+
+    root->subtreeSize_ += added;
+    omp_set_lock(&sizeLock_);
+        size_ += added;
+    omp_unset_lock(&sizeLock_);
+    walks_.exit(phase);
+
+    // Readers of the change stream have to resync. Done before unlocking, so that no snapshot pairs the result
+    // with the old version
+    if (changes_) {
+        changes_->reset();
+    }
+    unlockForSetOperation(other);
+
+    // The strings that changed are not known individually, so the whole result is checkpointed instead of logged
+    if (wal_) {
+        checkpoint();
+    }
+}
+
+// Removes every string that is not also in other from this ConcurrentTrie.
+// Subtrees that do not exist in other are dropped whole.
+void ConcurrentTrie::intersect(ConcurrentTrie& other) {
+
+    if (&other == this) {
+        return;
+    }
+
+    lockForSetOperation(other);
+    detachMutex_.lock();  // Subtrees are dropped whole, as in removeSubtrees()
+
+    std::shared_ptr<ConcurrentNode> root = writableRoot();
+    int numThreads = context_->threadsFor(KEY_OVERHEAD * (size_ + other.size_));
+    int removed = 0;
+    std::vector<std::vector<DroppedSubtree>> dropped(NODE_SIZE);
+    #pragma omp parallel for num_threads(numThreads) if(numThreads > 1) schedule(dynamic) reduction(+:removed)
+    for (int i = 0; i < NODE_SIZE; i++) {
+        std::string prefix;
+        std::vector<std::shared_ptr<ConcurrentNode>> path = {root};
+        removed += intersectChild(root, other.root_, i, prefix, path, dropped[i]);
+    }
+
+    // Writers that were inside the dropped subtrees count what they add to the nodes above them as well, so the
+    // subtrees are counted once they have finished
+    walks_.wait();
+    std::vector<std::shared_ptr<ConcurrentNode>> subtrees;
+    for (int i = 0; i < NODE_SIZE; i++) {
+        for (DroppedSubtree& subtree : dropped[i]) {
+            int numStrings = subtree.node->subtreeSize_;
+            for (int j = 1; j < subtree.path.size(); j++) {  // The root is taken care of with the other removals
+                subtree.path[j]->subtreeSize_ -= numStrings;
+            }
+            removed += numStrings;
+            if (filter_) {
+                updateFilter(filter_.get(), subtree.node, subtree.prefix, false);
+            }
+            subtrees.push_back(std::move(subtree.node));
+        }
+    }
+    detachMutex_.unlock();
+    freeSubtrees(subtrees, numThreads);
+
+    root->subtreeSize_ -= removed;
+    omp_set_lock(&sizeLock_);
+        size_ -= removed;
+    omp_unset_lock(&sizeLock_);
+
+    // Readers of the change stream have to resync. Done before unlocking, so that no snapshot pairs the result
+    // with the old version
+    if (changes_) {
+        changes_->reset();
+    }
+    unlockForSetOperation(other);
+
+    // The strings that changed are not known individually, so the whole result is checkpointed instead of logged
+    if (wal_) {
+        checkpoint();
+    }
+}
+
+// Removes every string that is also in other from this ConcurrentTrie.
+// Subtrees that do not exist in other are skipped without being visited.
+void ConcurrentTrie::difference(ConcurrentTrie& other) {
+
+    // Removing a trie from itself empties it, but other would be read-locked while this is being written
+    std::shared_ptr<ConcurrentTrie> copy;
+    ConcurrentTrie* source = &other;
+    if (&other == this) {
+        copy = std::make_shared<ConcurrentTrie>();
+        copy->unionWith(other);
+        source = copy.get();
+    }
+
+    lockForSetOperation(*source);
+    int phase = walks_.enter();
+
+    std::shared_ptr<ConcurrentNode> root = writableRoot();
+    int numThreads = context_->threadsFor(KEY_OVERHEAD * (size_ + source->size_));
+    int removed = 0;
+    #pragma omp parallel for num_threads(numThreads) if(numThreads > 1) schedule(dynamic) reduction(+:removed)
+    for (int i = 0; i < NODE_SIZE; i++) {
+        std::string prefix;
+        removed += differenceChild(root, source->root_, i, prefix);
+    }
+
+    root->subtreeSize_ -= removed;
+    omp_set_lock(&sizeLock_);
+        size_ -= removed;
+    omp_unset_lock(&sizeLock_);
+    walks_.exit(phase);
+
+    if (changes_) {
+        changes_->reset();
+    }
+    unlockForSetOperation(*source);
+
+    if (wal_) {
+        checkpoint();
+    }
+}
+
+// Write-locks this ConcurrentTrie and read-locks other.
+// The two tries are always locked in address order, so that a.unionWith(b) and b.unionWith(a)
+// running at the same time cannot deadlock.
+void ConcurrentTrie::lockForSetOperation(ConcurrentTrie& other) {
+    if (this < &other) {
+        rwLock_->startWrite();
+        other.asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+        other.rwLock_->startRead();
+    } else {
+        other.asyncWriteLock_->startRead();
+        other.rwLock_->startRead();
+        rwLock_->startWrite();
+    }
+}
+
+void ConcurrentTrie::unlockForSetOperation(ConcurrentTrie& other) {
+    other.rwLock_->endRead();
+    other.asyncWriteLock_->endRead();
+    rwLock_->endWrite();
+}
+
+// Returns a copy of the subtree rooted at node, and sets numStrings to the number of strings in it.
+std::shared_ptr<ConcurrentNode> ConcurrentTrie::copySubtree(const std::shared_ptr<ConcurrentNode>& node, int* numStrings) {
+
+    std::shared_ptr<ConcurrentNode> copy = newNode(node->selfIndex_);
+    copy->isEnd_ = node->isEnd_;
+    *numStrings = node->isEnd_ ? 1 : 0;
+
+    for (int i = 0; i < NODE_SIZE; i++) {
+        if (node->children_[i]) {
+            int childStrings;
+            std::shared_ptr<ConcurrentNode> childCopy = copySubtree(node->children_[i], &childStrings);
+            copy->children_[i] = childCopy;
+            copy->numChildren_++;
+            *numStrings += childStrings;
+        }
+    }
+    copy->subtreeSize_ = *numStrings;
+    return copy;
+}
+
+// Unlinks child index of node if no strings are left under it. Returns true if the child was unlinked.
+bool ConcurrentTrie::detachChildIfEmpty(const std::shared_ptr<ConcurrentNode>& node, int depth, int index) {
+
+    node->nodeLock_.lock();
+        std::shared_ptr<ConcurrentNode> child = node->children_[index];
+    node->nodeLock_.unlock();
+    bool detached = child && TrieCore<ConcurrentPolicy>::tryUnlinkChild(node.get(), child.get(), index);
+    if (detached) {
+        jumpLinkChanged(node.get(), depth, index);
+    }
+    return detached;
+}
+
+int ConcurrentTrie::unionChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix,
+                               bool* pruned) {
+
+    std::shared_ptr<ConcurrentNode> otherChild = otherNode->children_[index];
+    if (!otherChild) {
+        return 0;  // Nothing to add under this child
+    }
+
+    std::shared_ptr<ConcurrentNode> child = writableChild(node, prefix.length(), index, false);
+    if (!child) {
+
+        // The whole subtree is missing here - copy it over without holding the lock,
+        // and only link it in if no other writer created the child in the meantime
+        int numStrings;
+        std::shared_ptr<ConcurrentNode> copy = copySubtree(otherChild, &numStrings);
+
+        node->nodeLock_.lock();
+            if (node->unlinked_) {
+                node->nodeLock_.unlock();
+                *pruned = true;
+                return 0;
+            }
+            if (!node->children_[index]) {
+                node->children_[index] = copy;
+                node->numChildren_++;
+            }
+            child = node->children_[index];
+        node->nodeLock_.unlock();
+
+        if (child == copy) {
+            jumpLinkChanged(node.get(), prefix.length(), index);
+            if (filter_) {
+                updateFilter(filter_.get(), copy, prefix + getCharForIndex(index), true);
+            }
+            return numStrings;
+        }
+    }
+
+    prefix.push_back(getCharForIndex(index));
+
+    int added = 0;
+    child->nodeLock_.lock();
+        if (child->unlinked_) {
+            child->nodeLock_.unlock();
+            prefix.pop_back();
+            *pruned = true;
+            return 0;
+        }
+        if (otherChild->isEnd_ && !child->isEnd_) {
+            if (filter_) {
+                filter_->add(prefix.data(), prefix.length());
+            }
+            child->isEnd_ = true;
+            added++;
+        }
+    child->nodeLock_.unlock();
+
+    for (int i = 0; i < NODE_SIZE; i++) {
+        added += unionChild(child, otherChild, i, prefix, pruned);
+    }
+    child->subtreeSize_ += added;
+
+    prefix.pop_back();
+    return added;
+}
+
+int ConcurrentTrie::intersectChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix,
+                                   std::vector<std::shared_ptr<ConcurrentNode>>& path, std::vector<DroppedSubtree>& dropped) {
+
+    node->nodeLock_.lock();  // Other writers may be linking or unlinking it
+        std::shared_ptr<ConcurrentNode> child = node->children_[index];
+    node->nodeLock_.unlock();
+    if (!child) {
+        return 0;  // Nothing to remove under this child
+    }
+
+    std::shared_ptr<ConcurrentNode> otherChild = otherNode->children_[index];  // other is read-locked
+    if (!otherChild) {
+
+        // None of the strings under this child are in other - drop the whole subtree. It is marked unlinked_ like
+        // the subtrees of removeSubtrees(), so that writers adding to it start again from the root
+        bool detached = false;
+        node->nodeLock_.lock();
+            if (node->children_[index] == child) {
+                child->nodeLock_.lock();
+                    child->unlinked_ = true;
+                child->nodeLock_.unlock();
+                node->children_[index] = NULL;
+                node->numChildren_--;
+                prefixRemovals_++;
+                detached = true;
+            }
+        node->nodeLock_.unlock();
+        if (detached) {
+            jumpLinkChanged(node.get(), prefix.length(), index);
+            dropped.push_back({child, prefix + getCharForIndex(index), path});
+        }
+        return 0;
+    }
+
+    child = writableChild(node, prefix.length(), index, false);
+    if (!child) {
+        return 0;  // Removed by another writer in the meantime
+    }
+
+    prefix.push_back(getCharForIndex(index));
+
+    int removed = 0;
+    child->nodeLock_.lock();
+        if (child->isEnd_ && !otherChild->isEnd_) {
+            child->isEnd_ = false;
+            if (filter_) {
+                filter_->remove(prefix.data(), prefix.length());
+            }
+            removed++;
+        }
+    child->nodeLock_.unlock();
+
+    path.push_back(child);
+    for (int i = 0; i < NODE_SIZE; i++) {
+        removed += intersectChild(child, otherChild, i, prefix, path, dropped);
+    }
+    path.pop_back();
+    child->subtreeSize_ -= removed;
+
+    prefix.pop_back();
+
+    detachChildIfEmpty(node, prefix.length(), index);
+    return removed;
+}
+
+int ConcurrentTrie::differenceChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix) {
+
+    node->nodeLock_.lock();  // Other writers may be linking or unlinking it
+        std::shared_ptr<ConcurrentNode> child = node->children_[index];
+    node->nodeLock_.unlock();
+    std::shared_ptr<ConcurrentNode> otherChild = otherNode->children_[index];  // other is read-locked
+    if (!child || !otherChild) {
+        return 0;  // Either nothing to remove, or nothing in other to remove
+    }
+
+    child = writableChild(node, prefix.length(), index, false);
+    if (!child) {
+        return 0;  // Removed by another writer in the meantime
+    }
+
+    prefix.push_back(getCharForIndex(index));
+
+    int removed = 0;
+    child->nodeLock_.lock();
+        if (child->isEnd_ && otherChild->isEnd_) {
+            child->isEnd_ = false;
+            if (filter_) {
+                filter_->remove(prefix.data(), prefix.length());
+            }
+            removed++;
+        }
+    child->nodeLock_.unlock();
+
+    for (int i = 0; i < NODE_SIZE; i++) {
+        removed += differenceChild(child, otherChild, i, prefix);
+    }
+    child->subtreeSize_ -= removed;
+
+    prefix.pop_back();
+
+    detachChildIfEmpty(node, prefix.length(), index);
+    return removed;
+}
+
+
+// Returns the longest string in the ConcurrentTrie that is a prefix of key (possibly key itself),
+// or an empty string if there is none.
+// This is a single root-to-leaf walk. Readers exclude writers through rwLock_, so the walk does not need node locks.
+std::string ConcurrentTrie::longestPrefixOf(std::string key) {
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::shared_ptr<ConcurrentNode> cur = root_;
+    int longest = 0;
+    for (int i = 0; i < key.length(); i++) {
+        int index = int(key[i]);
+        if (index < SMALLEST_CHAR || index > LARGEST_CHAR || !cur->children_[index]) {
+            break;  // No string in the trie continues along key from here
+        }
+        cur = cur->children_[index];
+        if (cur->isEnd_) {
+            longest = i + 1;
+        }
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return key.substr(0, longest);
+}
+
+// Returns every string in the ConcurrentTrie that is a prefix of key (possibly key itself), shortest first.
+std::vector<std::string> ConcurrentTrie::allPrefixesOf(std::string key) {
+
+    std::vector<std::string> prefixes;
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::shared_ptr<ConcurrentNode> cur = root_;
+    for (int i = 0; i < key.length(); i++) {
+        int index = int(key[i]);
+        if (index < SMALLEST_CHAR || index > LARGEST_CHAR || !cur->children_[index]) {
+            break;
+        }
+        cur = cur->children_[index];
+        if (cur->isEnd_) {
+            prefixes.push_back(key.substr(0, i + 1));
+        }
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return prefixes;
+}
+
+
+// Puts a counting Bloom filter of memoryBytes bytes in front of contains(), so that most lookups of absent
+// strings return without taking any lock or touching a node. The filter is kept up to date by every change,
+// and is sized for falsePositiveRate - filterStats() reports how many strings it can hold at that rate.
+// Must be called before other threads use the ConcurrentTrie.
+void ConcurrentTrie::enableFilter(size_t memoryBytes, double falsePositiveRate) {
+    std::shared_ptr<CountingBloomFilter> filter = std::make_shared<CountingBloomFilter>(memoryBytes, falsePositiveRate);
+    updateFilter(filter.get(), root_, "", true);  // The strings already in the ConcurrentTrie
+    filter_ = filter;
+}
+
+// Returns the size of the filter, and its expected false positive rate with the strings now in the ConcurrentTrie.
+FilterStats ConcurrentTrie::filterStats() {
+    if (!filter_) {
+        throw std::logic_error("The filter is not enabled");
+    }
+    return filter_->stats(size());
+}
+
+// Puts a table with an entry for every pair of characters in front of the root, which leads straight to the node
+// reached by the first two characters of a string. contains() and countWithPrefix() then skip the root and the
+// first-level node - the most shared nodes of the trie, whose locks every lookup would otherwise take. Writers
+// forget the entries whose links they change, and lookups fill them in again on first use.
+// The table takes NODE_SIZE * NODE_SIZE entries (256 KB). Must be called before other threads use the ConcurrentTrie.
+void ConcurrentTrie::enableJumpTable() {
+    if (jumpTable_) {
+        return;
+    }
+    std::unique_ptr<JumpEntry[]> table(new JumpEntry[NODE_SIZE * NODE_SIZE]);
+    for (int i = 0; i < NODE_SIZE * NODE_SIZE; i++) {
+        table[i].node.store(NULL, std::memory_order_relaxed);
+        table[i].known.store(false, std::memory_order_relaxed);
+    }
+    jumpTable_ = std::move(table);
+}
+
+void ConcurrentTrie::updateFilter(CountingBloomFilter* filter, const std::shared_ptr<ConcurrentNode>& node, const std::string& prefix, bool add) {
+    std::vector<std::string> strings = getAllStringsSortedHelper(node, prefix);
+    for (int i = 0; i < strings.size(); i++) {
+        if (add) {
+            filter->add(strings[i].data(), strings[i].length());
+        } else {
+            filter->remove(strings[i].data(), strings[i].length());
+        }
+    }
+}
+
+// Makes the ConcurrentTrie durable, keeping its log and checkpoints in directory. Whatever was recovered from
+// directory is loaded first: the latest checkpoint, and then every committed change logged after it.
+// From then on every change is logged and fsynced before the method making it returns, and a checkpoint is
+// taken once checkpointEvery changes have been logged since the last one (0 to only take them explicitly).
+// Must be called on an empty ConcurrentTrie, before any other thread uses it.
+void ConcurrentTrie::enableDurability(std::string directory, long long checkpointEvery) {
+
+    if (wal_ || size_ != 0) {
+        throw std::logic_error("Durability must be enabled on an empty trie, and only once");
+    }
+
+    long long numReplayed = 0;
+    long long lastLsn = WriteAheadLog::recover(directory,
+        [this](const std::vector<std::string>& keys) {
+            std::vector<std::string> words = keys;
+            insert(&words);
+        },
+        [this, &numReplayed](char op, const std::string& key) {
+            if (op == WriteAheadLog::OP_INSERT) {
+                insert(key);
+            } else if (op == WriteAheadLog::OP_REMOVE) {
+                remove(key);
+            } else if (op == WriteAheadLog::OP_REMOVE_PREFIX) {
+                removePrefix(key);
+            }
+            numReplayed++;
+        });
+
+    wal_ = std::make_shared<WriteAheadLog>(directory, lastLsn);
+    checkpointEvery_ = checkpointEvery;
+    if (checkpointEvery_ > 0) {
+        checkpointThread_ = std::thread(&ConcurrentTrie::runCheckpoints, this);
+    }
+
+    // Fold the replayed changes into a new checkpoint, so that they are not replayed again next time
+    if (numReplayed > 0) {
+        checkpoint();
+    }
+}
+
+// Writes a checkpoint of the current contents, after which the log records before it are deleted.
+// Writers are only held up while the checkpoint is cut off from the log, not while it is written out.
+void ConcurrentTrie::checkpoint() {
+    if (!wal_) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(checkpointMutex_);
+    writeCheckpoint();
+}
+
+void ConcurrentTrie::writeCheckpoint() {
+
+    // With the read locks held no writer is running, so the snapshot contains exactly the logged changes
+    // up to the end of the segment that rotate() closes
+    asyncWriteLock_->startRead();
+    rwLock_->startRead();
+    std::shared_ptr<TrieSnapshot> snap = takeSnapshot();
+    long long lsn = wal_->rotate();
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+
+    wal_->writeCheckpoint(snap->getAllStringsSorted(), lsn);
+}
+
+// Waits until every log record up to lsn is durable. Writers that call this at the same time share one fsync.
+void ConcurrentTrie::commitLog(long long lsn) {
+    if (wal_ && lsn > 0) {
+        wal_->commit(lsn);
+    }
+}
+
+// Asks for a checkpoint if enough changes have been logged since the last one. The checkpoint is taken by
+// runCheckpoints() rather than by the writer, which would otherwise wait for the read locks on its own call path -
+// behind writers that may in turn be waiting for it.
+void ConcurrentTrie::maybeCheckpoint() {
+    if (!wal_ || checkpointEvery_ <= 0 || wal_->recordsSinceCheckpoint() < checkpointEvery_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(checkpointRequestMutex_);
+        checkpointPending_ = true;
+    }
+    checkpointRequested_.notify_one();
+}
+
+// Takes the checkpoints asked for by maybeCheckpoint(), until the ConcurrentTrie is destroyed. A failed log is left
+// for the writers to report, since every change after it throws.
+void ConcurrentTrie::runCheckpoints() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(checkpointRequestMutex_);
+            while (!checkpointPending_ && !stopCheckpoints_) {
+                checkpointRequested_.wait(lock);
+            }
+            if (stopCheckpoints_) {
+                return;
+            }
+            checkpointPending_ = false;
+        }
+        std::lock_guard<std::mutex> guard(checkpointMutex_);
+        if (wal_->recordsSinceCheckpoint() >= checkpointEvery_) {
+            try {
+                writeCheckpoint();
+            } catch (const std::runtime_error&) {
+                // Reported by the writers
+            }
+        }
+    }
+}
+
+// Starts keeping a version that every committed insert, remove and prefix removal moves on by one, and the last
+// capacity of those changes (see utils/change_stream.h), so that a copy of the trie kept elsewhere can be brought
+// up to date with changesSince() at a cost that depends on the number of changes rather than the number of strings.
+// The version starts at 0 with whatever the trie already holds. Must be called before other threads use the
+// ConcurrentTrie, and only once.
+void ConcurrentTrie::enableChangeStream(size_t capacity) {
+    if (changes_) {
+        throw std::logic_error("The change stream can only be enabled once");
+    }
+    changes_ = std::make_shared<ChangeStream>(capacity);
+}
+
+// Returns the version of the latest change, or 0 if the change stream is not enabled.
+long long ConcurrentTrie::version() {
+    return changes_ ? changes_->version() : 0;
+}
+
+// Returns the changes made after version, in the order they were made, or reports that they are no longer kept.
+// A reader that has to resync takes a snapshot, loads it, and carries on from the snapshot's version().
+// Changes to one string are ordered the way they happened, as in the log (see WalkHooks::adding()).
+// Changes are recorded before their writers commit them, so if durability is enabled this commits the log up to
+// the last change returned first - a copy kept elsewhere never holds a change that recovery after a crash would not.
+ChangeSet ConcurrentTrie::changesSince(long long version) {
+    if (!changes_) {
+        throw std::logic_error("The change stream is not enabled");
+    }
+    ChangeSet changeSet = changes_->since(version);
+    long long lastLsn = 0;
+    for (int i = 0; i < changeSet.changes.size(); i++) {
+        lastLsn = std::max(lastLsn, changeSet.changes[i].lsn);
+    }
+    commitLog(lastLsn);
+    return changeSet;
+}
+
+
+// Returns an immutable view of the ConcurrentTrie as it is now.
+// This only waits for the writers that are already running, and is then O(1): starting a new epoch makes
+// writers copy any node they would change from then on, instead of changing the snapshot's nodes.
+std::shared_ptr<TrieSnapshot> ConcurrentTrie::snapshot() {
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+    std::shared_ptr<TrieSnapshot> snap = takeSnapshot();
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+    return snap;
+}
+
+std::shared_ptr<TrieSnapshot> ConcurrentTrie::takeSnapshot() {
+    omp_set_lock(&rootLock_);  // Other snapshots may be taken at the same time
+        std::shared_ptr<ConcurrentNode> root = root_;
+        if (root->epoch_ == epoch_) {
+            epoch_++;  // Otherwise nothing was written since the last snapshot, and root is already frozen
+        }
+        int size = size_;
+    omp_unset_lock(&rootLock_);
+    long long version = changes_ ? changes_->version() : 0;  // No writer is running, so this matches root
+    return std::make_shared<TrieSnapshot>(root, size, version, context_);
+}
+
+// Given a prefix, return all words in the ConcurrentTrie that strictly starts with that prefix.
+// The words are read from a snapshot, so the result is consistent even while writers keep going.
+std::vector<std::string> ConcurrentTrie::getStringsWithPrefix(std::string prefix) {
+    return snapshot()->getStringsWithPrefix(prefix);
+}
+
+
+// Like getStringsWithPrefix(), but returns the strings front-coded in one buffer (see utils/front_coded_block.h),
+// which for large results takes a fraction of the memory and allocations of a vector of strings.
+FrontCodedBlock ConcurrentTrie::getStringsWithPrefixFrontCoded(std::string prefix) {
+    return snapshot()->getStringsWithPrefixFrontCoded(prefix);
+}
+
+// Returns all strings in the ConcurrentTrie, sorted alphabetically.
+std::vector<std::string> ConcurrentTrie::getAllStringsSorted() {
+    return snapshot()->getAllStringsSorted();
+}
+
+// Like getAllStringsSortedHelper(), but shares the work out between the threads. The subtree is cut into pieces
+// of about the same number of strings, in sorted order, and each run of pieces is listed by whichever thread is
+// free (see utils/cost_chunks.h). The lists are then joined in order. The number of threads is picked by context
+// from the number of strings.
+std::vector<std::string> ConcurrentTrie::getAllStringsSortedParallel(const std::shared_ptr<ConcurrentNode>& node, const std::string& prefix,
+                                                                     ExecutionContext& context) {
+
+    if (node == NULL) {
+        return getAllStringsSortedHelper(node, prefix);
+    }
+    int numThreads = context.threadsFor(KEY_OVERHEAD * (long long) node->subtreeSize_);
+    if (numThreads == 1) {
+        return getAllStringsSortedHelper(node, prefix);
+    }
+
+    long long grain = std::max(1, node->subtreeSize_ / (numThreads * CHUNKS_PER_THREAD));
+    std::vector<SortedPiece> pieces;
+    std::string path = prefix;
+    cutIntoPieces(node, path, grain, pieces);
+    if (pieces.size() == 1) {
+        return getAllStringsSortedHelper(node, prefix);  // Too small to be worth sharing out
+    }
+
+    std::vector<int> chunks = chunkByCost(pieces.size(), [&pieces](int i) {
+        return pieces[i].wholeSubtree ? (long long) pieces[i].node->subtreeSize_ : 1LL;
+    }, grain, numThreads);
+
+    std::vector<std::vector<std::string>> chunkStrings(chunks.size() - 1);
+    #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+    for (int c = 0; c < (int) chunks.size() - 1; c++) {
+        for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+            if (!pieces[i].wholeSubtree) {
+                chunkStrings[c].push_back(pieces[i].prefix);
+                continue;
+            }
+            std::vector<std::string> strings = getAllStringsSortedHelper(pieces[i].node, pieces[i].prefix);
+            chunkStrings[c].insert(chunkStrings[c].end(), std::make_move_iterator(strings.begin()), std::make_move_iterator(strings.end()));
+        }
+    }
+
+    std::vector<std::string> words;
+    words.reserve(node->subtreeSize_);
+    for (int c = 0; c < chunkStrings.size(); c++) {
+        words.insert(words.end(), std::make_move_iterator(chunkStrings[c].begin()), std::make_move_iterator(chunkStrings[c].end()));
+    }
+    return words;
+}
+
+// Appends the pieces of the subtree of node, which is reached by prefix, to pieces in sorted order. Subtrees of up to
+// grain strings are whole pieces, and larger ones are split into the string of node itself and its children's pieces.
+void ConcurrentTrie::cutIntoPieces(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, long long grain, std::vector<SortedPiece>& pieces) {
+    if (node->subtreeSize_ <= grain) {
+        pieces.push_back(SortedPiece{node, prefix, true});
+        return;
+    }
+    if (node->isEnd_) {
+        pieces.push_back(SortedPiece{node, prefix, false});
+    }
+    for (int i = 0; i < NODE_SIZE; i++) {
+        if (node->children_[i]) {
+            prefix.push_back(getCharForIndex(i));
+            cutIntoPieces(node->children_[i], prefix, grain, pieces);
+            prefix.pop_back();
+        }
+    }
+}
+
+// Helper function for getAllStringsSorted()
+std::vector<std::string> ConcurrentTrie::getAllStringsSortedHelper(std::shared_ptr<ConcurrentNode> node, std::string prefix) {
+    std::vector<std::string> words;
+    TrieCore<ConcurrentPolicy>::appendStrings(node.get(), prefix, words);
+    return words;
+}
+
+
+// Returns all strings in the ConcurrentTrie within Levenshtein distance maxDistance of word, sorted alphabetically.
+// The trie is walked depth-first while keeping one row of the edit distance table per level, so a subtree
+// is skipped as soon as every entry of its row exceeds maxDistance.
+std::vector<std::string> ConcurrentTrie::fuzzySearch(std::string word, int maxDistance) {
+
+    if (maxDistance < 0) {
+        return std::vector<std::string>();
+    }
+
+    if (!isValidKey(word.data(), word.length())) {
+        throw std::invalid_argument("Invalid character");  // As contains() does
+    }
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    // Row for the empty prefix: distance from "" to each prefix of word
+    std::vector<int> firstRow(word.length() + 1);
+    for (int j = 0; j <= word.length(); j++) {
+        firstRow[j] = j;
+    }
+
+    // Each child of the root is explored as its own task.
+    // Results are kept per branch so that concatenating them in index order keeps them sorted.
+    std::vector<std::string> branchResults[NODE_SIZE];
+
+    // At most every string below the root is visited, so small tries are searched without starting a team
+    int numThreads = context_->threadsFor(KEY_OVERHEAD * (long long) root_->subtreeSize_);
+    #pragma omp parallel num_threads(numThreads) if(numThreads > 1)
+    #pragma omp single
+    for (int i = 0; i < NODE_SIZE; i++) {
+        if (root_->children_[i]) {
+            #pragma omp task firstprivate(i) shared(branchResults, firstRow, word)
+            {
+                std::string prefix(1, getCharForIndex(i));
+                fuzzySearchHelper(root_->children_[i], prefix, word, firstRow, maxDistance, branchResults[i]);
+            }
+        }
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+
+    std::vector<std::string> results;
+    for (int i = 0; i < NODE_SIZE; i++) {
+        results.insert(results.end(), branchResults[i].begin(), branchResults[i].end());
+    }
+    return results;
+}
+
+// Helper function for fuzzySearch()
+// prevRow holds the edit distances between the parent's prefix and every prefix of word.
+void ConcurrentTrie::fuzzySearchHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const std::string& word,
+                                       const std::vector<int>& prevRow, int maxDistance, std::vector<std::string>& results) {
+
+    char c = prefix.back();
+    int wordLength = word.length();
+
+    std::vector<int> row(wordLength + 1);
+    row[0] = prevRow[0] + 1;
+    int rowMin = row[0];
+    for (int j = 1; j <= wordLength; j++) {
+        int insertCost = row[j - 1] + 1;
+        int deleteCost = prevRow[j] + 1;
+        int replaceCost = prevRow[j - 1] + (word[j - 1] == c ? 0 : 1);
+        row[j] = std::min(insertCost, std::min(deleteCost, replaceCost));
+        rowMin = std::min(rowMin, row[j]);
+    }
+
+    if (node->isEnd_ && row[wordLength] <= maxDistance) {
+        results.push_back(prefix);  // We have a word
+    }
+
+    if (rowMin > maxDistance) {
+        return;  // No extension of this prefix can get back within maxDistance
+    }
+
+    for (int i = 0; i < NODE_SIZE; i++) {  // Children in order, so results stay sorted
+        if (node->children_[i]) {
+            prefix.push_back(getCharForIndex(i));
+            fuzzySearchHelper(node->children_[i], prefix, word, row, maxDistance, results);
+            prefix.pop_back();
+        }
+    }
+}
+
+
+// Returns all strings in the ConcurrentTrie that match a wildcard pattern (see WildcardPattern), sorted alphabetically.
+// Branches under the root are explored as parallel OpenMP tasks, and a subtree is skipped as soon as
+// no continuation of its prefix can match.
+std::vector<std::string> ConcurrentTrie::match(std::string pattern) {
+
+    WildcardPattern compiled(pattern);
+    WildcardPattern::State startState = compiled.start();
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::vector<std::string> branchResults[NODE_SIZE];
+
+    // Sized like fuzzySearch()
+    int numThreads = context_->threadsFor(KEY_OVERHEAD * (long long) root_->subtreeSize_);
+    #pragma omp parallel num_threads(numThreads) if(numThreads > 1)
+    #pragma omp single
+    for (int i = 0; i < NODE_SIZE; i++) {
+        if (!root_->children_[i]) {
+            continue;
+        }
+        WildcardPattern::State childState = compiled.step(startState, getCharForIndex(i));
+        if (compiled.isDead(childState)) {
+            continue;
+        }
+        #pragma omp task firstprivate(i, childState) shared(branchResults, compiled)
+        {
+            std::string prefix(1, getCharForIndex(i));
+            std::vector<std::string>& results = branchResults[i];
+            matchHelper(root_->children_[i], prefix, compiled, childState, [&results](const std::string& word) {
+                results.push_back(word);
+                return true;
+            });
+        }
+    }
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+
+    std::vector<std::string> results;
+    for (int i = 0; i < NODE_SIZE; i++) {
+        results.insert(results.end(), branchResults[i].begin(), branchResults[i].end());
+    }
+    return results;
+}
+
+// Streams the strings that match a wildcard pattern to callback in sorted order, one at a time.
+// Enumeration stops as soon as callback returns false, so only as much of the trie is visited as is consumed.
+// The trie is read-locked until this returns, so callback must not modify the trie.
+void ConcurrentTrie::match(std::string pattern, std::function<bool(const std::string&)> callback) {
+
+    WildcardPattern compiled(pattern);
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    std::string prefix;
+    matchHelper(root_, prefix, compiled, compiled.start(), callback);
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+}
+
+// Helper function for match()
+bool ConcurrentTrie::matchHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const WildcardPattern& pattern,
+                                 const WildcardPattern::State& state, const std::function<bool(const std::string&)>& callback) {
+
+    if (node->isEnd_ && pattern.accepts(state)) {
+        if (!callback(prefix)) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < NODE_SIZE; i++) {  // Children in order, so results stay sorted
+        if (!node->children_[i]) {
+            continue;
+        }
+        char c = getCharForIndex(i);
+        WildcardPattern::State childState = pattern.step(state, c);
+        if (pattern.isDead(childState)) {
+            continue;  // Prune this subtree
+        }
+        prefix.push_back(c);
+        bool keepGoing = matchHelper(node->children_[i], prefix, pattern, childState, callback);
+        prefix.pop_back();
+        if (!keepGoing) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Builds an Aho-Corasick automaton over the strings currently in the ConcurrentTrie.
+// The trie is copied breadth-first into the scanner's own flat arrays, so later changes to the trie
+// do not affect the returned scanner.
+std::shared_ptr<TrieScanner> ConcurrentTrie::compileScanner() {
+
+    std::vector<int> edgeStart;
+    std::vector<char> edgeChars;
+    std::vector<int> edgeTargets;
+    std::vector<int> keyLength;
+
+    asyncWriteLock_->startRead();  // Waits for asyncWriters to finish
+    rwLock_->startRead();
+
+    // Queue of (node, depth) - states are numbered in the order they are pushed
+    std::queue<std::pair<std::shared_ptr<ConcurrentNode>, int>> queue;
+    queue.push(std::make_pair(root_, 0));
+    int numStates = 1;
+
+    while (!queue.empty()) {
+        std::shared_ptr<ConcurrentNode> node = queue.front().first;
+        int depth = queue.front().second;
+        queue.pop();
+
+        edgeStart.push_back(edgeChars.size());
+        keyLength.push_back(node->isEnd_ ? depth : 0);
+
+        for (int i = 0; i < NODE_SIZE; i++) {
+            if (node->children_[i]) {
+                edgeChars.push_back(getCharForIndex(i));
+                edgeTargets.push_back(numStates++);
+                queue.push(std::make_pair(node->children_[i], depth + 1));
+            }
+        }
+    }
+    edgeStart.push_back(edgeChars.size());
+
+    rwLock_->endRead();
+    asyncWriteLock_->endRead();
+
+    // A context of its own, with the trie's thread budget - scans cost per byte of text rather than per string, so
+    // their timings would throw off the trie's cost model
+    std::shared_ptr<ExecutionContext> context = std::make_shared<ExecutionContext>(context_->maxThreads());
+    return std::make_shared<TrieScanner>(edgeStart, edgeChars, edgeTargets, keyLength, context);
+}
+
+
+// Builds a minimal acyclic automaton of the strings currently in the ConcurrentTrie (see Dawg.h), from a snapshot,
+// so writers are only held up for as long as it takes to take one.
+std::shared_ptr<Dawg> ConcurrentTrie::minimize() {
+    return snapshot()->minimize();
+}
+
+
+TrieSnapshot::TrieSnapshot(std::shared_ptr<ConcurrentNode> root, int size, long long version, std::shared_ptr<ExecutionContext> context) {
+    root_ = root;
+    size_ = size;
+    version_ = version;
+    context_ = context;
+}
+
+// Returns the node for prefix, or NULL if no string in the snapshot starts with prefix.
+// Throws std::invalid_argument if prefix has a character that cannot be stored, as the ConcurrentTrie does.
+std::shared_ptr<ConcurrentNode> TrieSnapshot::findNode(const std::string& prefix) {
+    if (!ConcurrentTrie::isValidKey(prefix.data(), prefix.length())) {
+        throw std::invalid_argument("Invalid character");
+    }
+    std::shared_ptr<ConcurrentNode> cur = root_;
+    for (int i = 0; i < prefix.length() && cur; i++) {
+        cur = cur->children_[(unsigned char) prefix[i] - SMALLEST_CHAR];
+    }
+    return cur;
+}
+
+bool TrieSnapshot::contains(std::string word) {
+    std::shared_ptr<ConcurrentNode> node = findNode(word);
+    return node && node->isEnd_;
+}
+
+int TrieSnapshot::size() {
+    return size_;
+}
+
+// Returns the version of the trie's change stream that the snapshot holds every change up to, so that a reader
+// can load the snapshot and then follow the trie with changesSince(version()). 0 if the stream was not enabled.
+long long TrieSnapshot::version() {
+    return version_;
+}
+
+int TrieSnapshot::countWithPrefix(std::string prefix) {
+    std::shared_ptr<ConcurrentNode> node = findNode(prefix);
+    return node ? int(node->subtreeSize_) : 0;
+}
+
+std::vector<std::string> TrieSnapshot::getStringsWithPrefix(std::string prefix) {
+    std::shared_ptr<ConcurrentNode> node = findNode(prefix);
+    if (!node) {
+        return std::vector<std::string>();  // return empty vector
+    }
+    return ConcurrentTrie::getAllStringsSortedParallel(node, prefix, *context_);
+}
+
+FrontCodedBlock TrieSnapshot::getStringsWithPrefixFrontCoded(std::string prefix) {
+    FrontCodedBlock block;
+    TrieCore<ConcurrentPolicy>::frontCode(findNode(prefix).get(), prefix, block);
+    return block;
+}
+
+std::vector<std::string> TrieSnapshot::getAllStringsSorted() {
+    return ConcurrentTrie::getAllStringsSortedParallel(root_, "", *context_);
+}
+
+// Builds the minimal automaton by hash-consing the trie bottom-up. Nodes are finished in post-order, and each one
+// is described by whether a string ends there and its edges to the states its children became. Two nodes with the
+// same description have the same strings below them, so a node whose description has been seen before becomes the
+// state already made for it, and the automaton is minimal without ever being built in full.
+std::shared_ptr<Dawg> TrieSnapshot::minimize() {
+
+    std::vector<int> edgeStart(1, 0);
+    std::vector<char> edgeChars;
+    std::vector<int> edgeTargets;
+    std::vector<bool> isFinal;
+    std::unordered_map<std::string, int> registry;  // Description of each state -> its number
+
+    // Nodes on the path, with the next child of each to visit and the edges of the children already finished.
+    // An explicit stack, so that long strings cannot overflow the call stack.
+    struct Frame {
+        ConcurrentNode* node;
+        int next;
+        std::vector<std::pair<char, int>> edges;
+    };
+    std::vector<Frame> stack;
+    stack.push_back(Frame{root_.get(), 0, {}});
+
+    int state = -1;
+    std::string description;
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        while (frame.next < NODE_SIZE && !frame.node->children_[frame.next]) {
+            frame.next++;
+        }
+        if (frame.next < NODE_SIZE) {
+            ConcurrentNode* child = frame.node->children_[frame.next].get();
+            frame.next++;
+            stack.push_back(Frame{child, 0, {}});
+            continue;
+        }
+
+        // Every child has a state, so this node can be looked up
+        description.assign(1, frame.node->isEnd_ ? 1 : 0);
+        for (int e = 0; e < frame.edges.size(); e++) {
+            description.push_back(frame.edges[e].first);
+            description.append((const char*) &frame.edges[e].second, sizeof(int));
+        }
+        std::unordered_map<std::string, int>::iterator found = registry.find(description);
+        if (found != registry.end()) {
+            state = found->second;
+        } else {
+            state = isFinal.size();
+            isFinal.push_back(frame.node->isEnd_);
+            for (int e = 0; e < frame.edges.size(); e++) {
+                edgeChars.push_back(frame.edges[e].first);
+                edgeTargets.push_back(frame.edges[e].second);
+            }
+            edgeStart.push_back(edgeChars.size());
+            registry.emplace(description, state);
+        }
+
+        stack.pop_back();
+        if (!stack.empty()) {
+            stack.back().edges.push_back(std::make_pair(ConcurrentTrie::getCharForIndex(stack.back().next - 1), state));
         }
     }
-    return words;
 
+    return std::make_shared<Dawg>(edgeStart, edgeChars, edgeTargets, isFinal, state);
 }
@@ -1,28 +1,49 @@
 #pragma once
 
 #include <algorithm>  // std::find
+#include <atomic>
+#include <condition_variable>
+#include <functional>  // std::function
 #include <memory>  // std::shared_ptr, std::enable_shared_from_this
 #include <mutex>
 #include <omp.h>
 #include <pthread.h>
+#include <queue>
+#include <span>
 #include <stack>
-#include <stdexcept>  // std::invalid_argument
+#include <stdexcept>  // std::invalid_argument, std::out_of_range
+#include <stdint.h>  // uint8_t, uint64_t
 #include <stdio.h>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <utility>  // std::pair
 #include <vector>
 
+#include "Dawg.h"
+#include "TrieCore.h"
+#include "TrieScanner.h"
+#include "WriteAheadLog.h"
+#include "utils/change_stream.h"
+#include "utils/cost_chunks.h"
+#include "utils/counting_bloom_filter.h"
+#include "utils/execution_context.h"
+#include "utils/front_coded_block.h"
+#include "utils/grace_period.h"
+#include "utils/key_validation.h"
 #include "utils/readers_writers.h"
+#include "utils/word_list.h"
+#include "utils/wildcard_pattern.h"
 
 
-// #define NODE_SIZE 95  // Allow for 95 printable ASCII characters - from space (32) to tilde (126)
-
-#define SMALLEST_CHAR 0
-#define LARGEST_CHAR 127
-#define NODE_SIZE (LARGEST_CHAR - SMALLEST_CHAR + 1)
-
 class ConcurrentTrie;
+class TrieSnapshot;
+
+// Result of the non-throwing operations
+enum TrieStatus {
+    STATUS_OK,
+    STATUS_INVALID_KEY,  // The key has a character outside SMALLEST_CHAR..LARGEST_CHAR, and nothing was changed
+};
 
 struct InsertAsyncArgs {
     std::vector<std::string>* words;
@@ -31,50 +52,209 @@ struct InsertAsyncArgs {
 };
 
 
-class ConcurrentNode {
+// Nodes are reference counted, since copies of a node (see ConcurrentTrie::copyNode()) and snapshots share its
+// children, and have a lock each (see TrieCore.h).
+typedef TrieNode<ConcurrentPolicy> ConcurrentNode;
 
-    friend class ConcurrentTrie;
+// A piece of a subtree for getAllStringsSortedParallel() - either the whole subtree of node, or just the string
+// that ends at node
+struct SortedPiece {
+    std::shared_ptr<ConcurrentNode> node;
+    std::string prefix;
+    bool wholeSubtree;
+};
 
-    private:
-        std::shared_ptr<ConcurrentNode> children_[NODE_SIZE];
-        std::shared_ptr<ConcurrentNode> parent_;
-        bool isEnd_;
-        int numChildren_;
-        int selfIndex_;
-        omp_lock_t nodeLock_;
+// A subtree that intersect() dropped whole - node is reached by prefix, and path holds the nodes from the root to its
+// parent, whose subtree sizes it is taken off once no writer can still be adding to it
+struct DroppedSubtree {
+    std::shared_ptr<ConcurrentNode> node;
+    std::string prefix;
+    std::vector<std::shared_ptr<ConcurrentNode>> path;
+};
 
-    public:
-        ConcurrentNode();
+// How a bulk operation is shared out (see ConcurrentTrie::planBulk())
+struct BulkPlan {
+    std::vector<int> chunks;  // Chunk c is words [chunks[c], chunks[c + 1])
+    int numThreads;  // 1 to run sequentially
+    long long totalCost;  // See utils/cost_chunks.h
+};
+
+// How a bulk operation on packed keys is shared out (see ConcurrentTrie::planPacked()). Chunk c starts at
+// packedChunkStart(offsets, numKeys, grain, c), rounded down to a multiple of align, and ends where chunk c + 1 starts.
+struct PackedPlan {
+    size_t numKeys;
+    long long grain;
+    long long numChunks;
+    size_t align;  // 64 when results are written as bits, so that no two threads write to the same word
+    int numThreads;  // 1 to run sequentially
+    long long totalCost;  // See utils/cost_chunks.h
+};
+
+// An entry of the root jump table (see ConcurrentTrie::enableJumpTable())
+struct JumpEntry {
+    std::atomic<ConcurrentNode*> node;  // The node reached by the entry's two characters, NULL if there is none
+    std::atomic<bool> known;  // False until a reader fills in node, and again once a writer changes the link to it
 };
 
 class ConcurrentTrie : public std::enable_shared_from_this<ConcurrentTrie> {
 
+    friend class TrieSnapshot;
+
     private:
         std::shared_ptr<ConcurrentNode> root_;
 
+        // Nodes may be shared with snapshots. Taking a snapshot starts a new epoch, and writers copy every node
+        // from an older epoch before changing it, so a snapshot never sees later changes (path copying).
+        int epoch_;
+        omp_lock_t rootLock_;  // For replacing root_ with a copy
+
         int size_;  // For keeping track of the number of strings in the trie
         omp_lock_t sizeLock_;  // For updating size_ in a thread-safe manner
         
         // For inserting and removing
         std::shared_ptr<FairReadersWriters> rwLock_;
 
+        // For removing whole subtrees while other writers run. Walks that add or remove strings are tracked by walks_,
+        // so that a subtree is only counted and freed once every walk that may still be inside it has finished.
+        // prefixRemovals_ is bumped each time subtrees are unlinked, so that an insert that may have landed in one
+        // knows to check (see insertWord()). Only one thread unlinks subtrees at a time, under detachMutex_.
+        GracePeriod walks_;
+        std::atomic<long long> prefixRemovals_;
+        std::mutex detachMutex_;
+
         // For async inserting and removing
         std::shared_ptr<FairReadersWriters> asyncWriteLock_;
 
+        // For answering most lookups of absent strings without the locks - NULL unless enableFilter() was called
+        std::shared_ptr<CountingBloomFilter> filter_;
+
+        // For skipping the root and first-level nodes - entry c0 * NODE_SIZE + c1 is for the strings that start
+        // with c0 c1. NULL unless enableJumpTable() was called
+        std::unique_ptr<JumpEntry[]> jumpTable_;
+
+        // For durability - wal_ is NULL unless enableDurability() was called
+        std::shared_ptr<WriteAheadLog> wal_;
+        long long checkpointEvery_;  // Number of log records after which a checkpoint is taken, 0 for never
+        std::mutex checkpointMutex_;  // Only one checkpoint is written at a time
+
+        // For taking the automatic checkpoints on a thread of their own, which holds no lock of the trie while it
+        // waits for one (see maybeCheckpoint()) - not started unless checkpointEvery_ is positive
+        std::thread checkpointThread_;
+        std::mutex checkpointRequestMutex_;  // Protects the variables below
+        std::condition_variable checkpointRequested_;
+        bool checkpointPending_;
+        bool stopCheckpoints_;
+
+        // For incremental export - changes_ is NULL unless enableChangeStream() was called
+        std::shared_ptr<ChangeStream> changes_;
+
+        // For the threads of this trie - its budget and cost model, independent of other tries
+        std::shared_ptr<ExecutionContext> context_;
+
         // Methods to help with basic operations
-        int getIndexOfChar(char c);
-        char getCharForIndex(int idx);
-        void possiblyDeleteNode(std::shared_ptr<ConcurrentNode> node);
+        static bool isValidKey(const char* key, size_t length);
+        static void checkKeys(std::vector<std::string>* words, const BulkPlan& plan);
+        BulkPlan planBulk(std::vector<std::string>* words, long long grainSize);
+        PackedPlan planPacked(std::span<const size_t> offsets, long long grainSize, size_t align);
+        static void checkPackedKeys(std::span<const char> data, std::span<const size_t> offsets, const PackedPlan& plan);
+        static size_t packedChunkBegin(std::span<const size_t> offsets, const PackedPlan& plan, long long c);
+        static char getCharForIndex(int idx);
+        void possiblyDeleteNode(std::vector<std::shared_ptr<ConcurrentNode>>& path);
+
+        // The parts of TrieCore's writer walks that are particular to this trie: copy-on-write, the jump table, and
+        // the filter, log and change stream entries of the strings that are added and removed
+        struct WalkHooks {
+            ConcurrentTrie* trie;
+            long long lsn;  // Of the log record written for the string, 0 if none was written
+            std::shared_ptr<ConcurrentNode> root();
+            std::shared_ptr<ConcurrentNode> newNode(int selfIndex);
+            std::shared_ptr<ConcurrentNode> copyIfShared(const std::shared_ptr<ConcurrentNode>& node);
+            void linkChanged(ConcurrentNode* node, int depth, int index);
+            void adding(const char* key, size_t length);
+            void removing(const char* key, size_t length);
+        };
+
+        // Methods to help with copy-on-write - these return nodes of the current epoch that writers may change
+        std::shared_ptr<ConcurrentNode> newNode(int selfIndex);
+        std::shared_ptr<ConcurrentNode> copyNode(const std::shared_ptr<ConcurrentNode>& node);
+        std::shared_ptr<ConcurrentNode> writableRoot();
+        std::shared_ptr<ConcurrentNode> writableChild(const std::shared_ptr<ConcurrentNode>& node, int depth, int index, bool create);
+
+        // Methods to help with the jump table
+        ConcurrentNode* jumpTo(const char* key);  // Must be called with the read locks held
+        void jumpLinkChanged(ConcurrentNode* node, int depth, int index);  // Must be called with rwLock_ held for writing
+
+        // Single-word insert and remove, which return the LSN of the log record written (0 if nothing changed
+        // or durability is off) but do not wait for it to become durable - so bulk operations commit only once.
+        // The word must already have been checked with isValidKey(). None of them take rwLock_ or asyncWriteLock_:
+        // the caller holds them, once for a whole bulk operation, since a thread that takes them again while a
+        // reader or writer of the other kind is queued would wait on itself.
+        long long insertWord(const char* word, size_t length);
+        long long removeWord(const char* word, size_t length);
+        bool containsWord(const char* word, size_t length);
+
+        // Methods to help with durability
+        std::shared_ptr<TrieSnapshot> takeSnapshot();  // Must be called with the read locks held
+        void commitLog(long long lsn);
+        void writeCheckpoint();  // Must be called with checkpointMutex_ held
+        void maybeCheckpoint();
+        void runCheckpoints();
         
         // To support async insert and remove - called in another thread by insertAsync and removeAsync
         static void insertAsyncHelper(std::shared_ptr<ConcurrentTrie> trie, std::vector<std::string>* words);
         static void removeAsyncHelper(std::shared_ptr<ConcurrentTrie> trie, std::vector<std::string>* words);
 
+        // Unlinks the subtrees under prefix - the shared part of removePrefix() and clear()
+        int removeSubtrees(const std::string& prefix, bool freeNow);
+
+        // Frees subtrees unlinked by removeSubtrees, and removes their strings (prefixes[i] is the prefix of subtrees[i])
+        // from the filter - called in another thread, once no walk can still be inside them
+        static void reclaimSubtrees(std::shared_ptr<CountingBloomFilter> filter, std::shared_ptr<ExecutionContext> context,
+                                    std::vector<std::shared_ptr<ConcurrentNode>> subtrees, std::vector<std::string> prefixes);
+        static void freeSubtrees(std::vector<std::shared_ptr<ConcurrentNode>>& subtrees, int numThreads);
+
+        // Adds every string in the subtree of node, which is reached by prefix, to the filter or removes them from it
+        static void updateFilter(CountingBloomFilter* filter, const std::shared_ptr<ConcurrentNode>& node, const std::string& prefix, bool add);
+
         // Helper methods for getting all strings in a sorted order given a particular node
-        std::vector<std::string> getAllStringsSortedHelper(std::shared_ptr<ConcurrentNode> node, std::string prefix);
+        static std::vector<std::string> getAllStringsSortedHelper(std::shared_ptr<ConcurrentNode> node, std::string prefix);
+        static std::vector<std::string> getAllStringsSortedParallel(const std::shared_ptr<ConcurrentNode>& node, const std::string& prefix,
+                                                                    ExecutionContext& context);
+        static void cutIntoPieces(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, long long grain, std::vector<SortedPiece>& pieces);
+
+        // Helper methods for set operations - each one combines child i of node with the corresponding child of
+        // otherNode (the same position in the other trie), and returns the number of strings added or removed.
+        // prefix is the string that leads to node. unionChild() sets *pruned if a node it was adding to was pruned by
+        // another writer, after which the strings it did not get to have to be added again from the root.
+        // intersectChild() does not count the subtrees it drops whole, but appends them to dropped, with path holding
+        // the nodes from the root to node.
+        void lockForSetOperation(ConcurrentTrie& other);
+        void unlockForSetOperation(ConcurrentTrie& other);
+        std::shared_ptr<ConcurrentNode> copySubtree(const std::shared_ptr<ConcurrentNode>& node, int* numStrings);
+        bool detachChildIfEmpty(const std::shared_ptr<ConcurrentNode>& node, int depth, int index);
+        int unionChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix,
+                       bool* pruned);
+        int intersectChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix,
+                           std::vector<std::shared_ptr<ConcurrentNode>>& path, std::vector<DroppedSubtree>& dropped);
+        int differenceChild(const std::shared_ptr<ConcurrentNode>& node, const std::shared_ptr<ConcurrentNode>& otherNode, int index, std::string& prefix);
+
+        // Helper method for range - node is reached by prefix, and boundedByLo is true if prefix is a prefix of lo.
+        // Returns false once hi or the limit is reached.
+        bool rangeHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const std::string& lo, const std::string& hi,
+                         bool boundedByLo, int limit, std::vector<std::string>& results);
+
+        // Helper method for fuzzySearch - extends the edit distance row by the last character of prefix
+        void fuzzySearchHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const std::string& word,
+                               const std::vector<int>& prevRow, int maxDistance, std::vector<std::string>& results);
+
+        // Helper method for match - node is reached by prefix, and state is the pattern state after reading prefix.
+        // Returns false once the callback asks to stop.
+        bool matchHelper(const std::shared_ptr<ConcurrentNode>& node, std::string& prefix, const WildcardPattern& pattern,
+                         const WildcardPattern::State& state, const std::function<bool(const std::string&)>& callback);
 
     public:
         ConcurrentTrie();
+        ~ConcurrentTrie();
         std::shared_ptr<ConcurrentTrie> createSharedPtr();
         
         void setNumThreads(int numThreads);
@@ -82,20 +262,101 @@ class ConcurrentTrie : public std::enable_shared_from_this<ConcurrentTrie> {
 
         // Basic operations
         void insert(std::string word);
-        void insert(std::vector<std::string>* words);
+        void insert(std::vector<std::string>* words, long long grainSize = 0);
         void insertAsync(std::vector<std::string>* words);
+        int insertFromFile(std::string filepath, int numWords = -1);
 
         bool contains(std::string word);
-        std::vector<bool> contains(std::vector<std::string>* words);
+        std::vector<bool> contains(std::vector<std::string>* words, long long grainSize = 0);
+
+        // Non-throwing versions of insert, remove and contains, which return STATUS_INVALID_KEY instead
+        TrieStatus tryInsert(const std::string& word);
+        TrieStatus tryRemove(const std::string& word);
+        TrieStatus tryContains(const std::string& word, bool* result);
 
         void remove(std::string word);
-        void remove(std::vector<std::string>* words);
+        void remove(std::vector<std::string>* words, long long grainSize = 0);
         void removeAsync(std::vector<std::string>* words);
+        int removePrefix(std::string prefix);
+        void clear();
+
+        // Bulk operations on packed keys - key i is data[offsets[i], offsets[i + 1]), so offsets has one more entry
+        // than there are keys. Nothing is allocated per call or per key, apart from the nodes that insert creates.
+        void insert(std::span<const char> data, std::span<const size_t> offsets, long long grainSize = 0);
+        void remove(std::span<const char> data, std::span<const size_t> offsets, long long grainSize = 0);
+        void contains(std::span<const char> data, std::span<const size_t> offsets, std::span<uint8_t> results, long long grainSize = 0);
+        void contains(std::span<const char> data, std::span<const size_t> offsets, std::span<uint64_t> bits, long long grainSize = 0);
 
         int size();
+        int countWithPrefix(std::string prefix);
+
+        // Negative lookup filter
+        void enableFilter(size_t memoryBytes, double falsePositiveRate = 0.01);
+        FilterStats filterStats();
+
+        // Root jump table
+        void enableJumpTable();
+
+        // Durability
+        void enableDurability(std::string directory, long long checkpointEvery = 100000);
+        void checkpoint();
+
+        // Change stream
+        void enableChangeStream(size_t capacity = 65536);
+        long long version();
+        ChangeSet changesSince(long long version);
+
+        // Set operations - modify this trie in place
+        void unionWith(ConcurrentTrie& other);
+        void intersect(ConcurrentTrie& other);
+        void difference(ConcurrentTrie& other);
+
+        // Ordered operations
+        std::vector<std::string> range(std::string lo, std::string hi, int limit = -1);
+        int rank(std::string key);
+        std::string select(int i);
+
+        // Prefix lookups
+        std::string longestPrefixOf(std::string key);
+        std::vector<std::string> allPrefixesOf(std::string key);
 
         // Advanced operations
+        std::shared_ptr<TrieSnapshot> snapshot();
         std::vector<std::string> getStringsWithPrefix(std::string prefix);
+        FrontCodedBlock getStringsWithPrefixFrontCoded(std::string prefix);
         std::vector<std::string> getAllStringsSorted();
+        std::vector<std::string> fuzzySearch(std::string word, int maxDistance);
+        std::vector<std::string> match(std::string pattern);
+        void match(std::string pattern, std::function<bool(const std::string&)> callback);
+        std::shared_ptr<TrieScanner> compileScanner();
+        std::shared_ptr<Dawg> minimize();
 
 };
+
+// An immutable, consistent view of a ConcurrentTrie at the time ConcurrentTrie::snapshot() was called.
+// Writers copy nodes before changing them instead of changing them in place, so reading a snapshot
+// needs no locks and is not affected by, nor holds up, later writes to the trie.
+class TrieSnapshot {
+
+    friend class ConcurrentTrie;
+
+    private:
+        std::shared_ptr<ConcurrentNode> root_;
+        int size_;
+        long long version_;  // The trie's change stream version when the snapshot was taken
+        std::shared_ptr<ExecutionContext> context_;  // The trie's, for listing strings in parallel
+
+        std::shared_ptr<ConcurrentNode> findNode(const std::string& prefix);
+
+    public:
+        TrieSnapshot(std::shared_ptr<ConcurrentNode> root, int size, long long version, std::shared_ptr<ExecutionContext> context);
+
+        bool contains(std::string word);
+        int size();
+        long long version();
+        int countWithPrefix(std::string prefix);
+        std::vector<std::string> getStringsWithPrefix(std::string prefix);
+        FrontCodedBlock getStringsWithPrefixFrontCoded(std::string prefix);
+        std::vector<std::string> getAllStringsSorted();
+        std::shared_ptr<Dawg> minimize();
+};
@@ -0,0 +1,159 @@
+#include "Dawg.h"
+
+#include <stdexcept>  // std::out_of_range
+#include <utility>  // std::pair
+
+
+Dawg::Dawg(std::vector<int> edgeStart, std::vector<char> edgeChars, std::vector<int> edgeTargets, std::vector<bool> isFinal, int root) {
+
+    edgeStart_ = edgeStart;
+    edgeChars_ = edgeChars;
+    edgeTargets_ = edgeTargets;
+    isFinal_ = isFinal;
+    root_ = root;
+
+    // Every edge leads to a lower state, so the states below each state have been counted by the time it is reached
+    int numStates = isFinal_.size();
+    numKeys_ = std::vector<int>(numStates, 0);
+    for (int s = 0; s < numStates; s++) {
+        numKeys_[s] = isFinal_[s] ? 1 : 0;
+        for (int e = edgeStart_[s]; e < edgeStart_[s + 1]; e++) {
+            numKeys_[s] += numKeys_[edgeTargets_[e]];
+        }
+    }
+}
+
+// Returns the target of the edge out of state labelled c, or -1 if there is none.
+int Dawg::findEdge(int state, char c) const {
+    int lo = edgeStart_[state];
+    int hi = edgeStart_[state + 1];
+    while (lo < hi) {  // Edges are sorted by character
+        int mid = (lo + hi) / 2;
+        if (edgeChars_[mid] < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < edgeStart_[state + 1] && edgeChars_[lo] == c) {
+        return edgeTargets_[lo];
+    }
+    return -1;
+}
+
+bool Dawg::contains(const std::string& word) const {
+    int state = root_;
+    for (int i = 0; i < word.length() && state != -1; i++) {
+        state = findEdge(state, word[i]);
+    }
+    return state != -1 && isFinal_[state];
+}
+
+// Appends the keys read from state onwards, each after prefix, to results in sorted order. The walk uses an
+// explicit stack, so that long keys cannot overflow the call stack.
+void Dawg::enumerate(int state, std::string& prefix, std::vector<std::string>& results) const {
+
+    size_t baseLength = prefix.length();
+    std::vector<std::pair<int, int>> stack;  // States on the path, and the next edge of each to follow
+    stack.push_back(std::make_pair(state, edgeStart_[state]));
+    if (isFinal_[state]) {
+        results.push_back(prefix);
+    }
+
+    while (!stack.empty()) {
+        int cur = stack.back().first;
+        int e = stack.back().second;
+        if (e == edgeStart_[cur + 1]) {
+            stack.pop_back();
+            if (prefix.length() > baseLength) {
+                prefix.pop_back();
+            }
+            continue;
+        }
+        stack.back().second = e + 1;
+        int target = edgeTargets_[e];
+        prefix.push_back(edgeChars_[e]);
+        stack.push_back(std::make_pair(target, edgeStart_[target]));
+        if (isFinal_[target]) {
+            results.push_back(prefix);
+        }
+    }
+}
+
+std::vector<std::string> Dawg::getAllStringsSorted() const {
+    return getStringsWithPrefix("");
+}
+
+// Returns the keys that start with prefix, in sorted order.
+std::vector<std::string> Dawg::getStringsWithPrefix(const std::string& prefix) const {
+    std::vector<std::string> results;
+    int state = root_;
+    for (int i = 0; i < prefix.length() && state != -1; i++) {
+        state = findEdge(state, prefix[i]);
+    }
+    if (state == -1) {
+        return results;
+    }
+    results.reserve(numKeys_[state]);
+    std::string path = prefix;
+    enumerate(state, path, results);
+    return results;
+}
+
+// Returns the number of keys before word in sorted order, or -1 if word is not a key. Every key that branches off
+// word's path at a lower character, or ends on the path, comes before it, and the number below each state is known,
+// so this takes one step per character of word.
+long long Dawg::ordinal(const std::string& word) const {
+    long long result = 0;
+    int state = root_;
+    for (int i = 0; i < word.length(); i++) {
+        if (isFinal_[state]) {
+            result++;  // A proper prefix of word
+        }
+        int e = edgeStart_[state];
+        for (; e < edgeStart_[state + 1] && edgeChars_[e] < word[i]; e++) {
+            result += numKeys_[edgeTargets_[e]];
+        }
+        if (e == edgeStart_[state + 1] || edgeChars_[e] != word[i]) {
+            return -1;
+        }
+        state = edgeTargets_[e];
+    }
+    return isFinal_[state] ? result : -1;
+}
+
+// Returns the key with the given ordinal, the inverse of ordinal().
+std::string Dawg::keyAt(long long ordinal) const {
+    if (ordinal < 0 || ordinal >= size()) {
+        throw std::out_of_range("Ordinal out of range");
+    }
+    std::string key;
+    int state = root_;
+    while (true) {
+        if (isFinal_[state]) {
+            if (ordinal == 0) {
+                return key;
+            }
+            ordinal--;
+        }
+        int e = edgeStart_[state];
+        while (ordinal >= numKeys_[edgeTargets_[e]]) {
+            ordinal -= numKeys_[edgeTargets_[e]];
+            e++;
+        }
+        key.push_back(edgeChars_[e]);
+        state = edgeTargets_[e];
+    }
+}
+
+int Dawg::size() const {
+    return numKeys_[root_];
+}
+
+int Dawg::numStates() const {
+    return isFinal_.size();
+}
+
+int Dawg::numEdges() const {
+    return edgeChars_.size();
+}
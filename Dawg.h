@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// An immutable minimal acyclic automaton (DAWG) over a fixed set of keys, produced by ConcurrentTrie::minimize().
+// It is the trie of the keys with every set of equivalent subtrees - the same strings below them - merged into
+// one state, so keys that share endings ("-s", "-ing", ".com") share states as well as prefixes.
+// Since it never changes after construction, it may be shared and used by any number of threads at once.
+class Dawg {
+
+    private:
+        // Edges in compressed row form - the edges of state s are edgeChars_/edgeTargets_[edgeStart_[s] .. edgeStart_[s + 1]),
+        // sorted by character. States are numbered so that every edge leads to a lower state, and root_ is the highest.
+        std::vector<int> edgeStart_;
+        std::vector<char> edgeChars_;
+        std::vector<int> edgeTargets_;
+
+        std::vector<bool> isFinal_;  // True if a key ends at the state
+        std::vector<int> numKeys_;  // Number of keys read from the state onwards - the same whichever path reached it
+
+        int root_;
+
+        int findEdge(int state, char c) const;
+        void enumerate(int state, std::string& prefix, std::vector<std::string>& results) const;
+
+    public:
+        Dawg(std::vector<int> edgeStart, std::vector<char> edgeChars, std::vector<int> edgeTargets, std::vector<bool> isFinal, int root);
+
+        bool contains(const std::string& word) const;
+
+        // Keys in sorted order
+        std::vector<std::string> getAllStringsSorted() const;
+        std::vector<std::string> getStringsWithPrefix(const std::string& prefix) const;
+
+        // Minimal perfect hashing - the ordinal of a key is the number of keys before it in sorted order
+        long long ordinal(const std::string& word) const;  // -1 if word is not a key
+        std::string keyAt(long long ordinal) const;  // Throws std::out_of_range if ordinal is not in [0, size())
+
+        int size() const;
+        int numStates() const;
+        int numEdges() const;
+};
@@ -1,36 +1,11 @@
 #include "ConcurrentTrie.h"
 
-#include <fstream>
 #include <vector>
 #include <unistd.h>
 #include <string>
 #include <thread>
 
 
-std::vector<std::string> loadWords(std::string filepath, int numWords) {
-    std::vector<std::string> wordList;
-    std::string word;
-
-    int wordNum = 0;
-    std::ifstream* wordListFile = new std::ifstream(filepath);
-    if (wordListFile->is_open()) {
-        while (std::getline(*wordListFile, word)) {
-            wordNum++;
-            // Check if word is valid
-            for (char c : word) {
-                if (int(c) < 0 || int(c) > 127) {
-                    printf("Word num %d is invalid\n", wordNum);
-                    break;
-                }
-            }
-            wordList.push_back(word);
-            if (wordNum == numWords) break;
-        }
-    }
-    return wordList;
-}
-
-
 void addString(std::shared_ptr<ConcurrentTrie> trie, std::string* string) {
     trie->insert(*string);
 }
@@ -1,46 +1,43 @@
 #include <algorithm>  // std::find
-#include <memory>  // std::shared_ptr
-#include <stack>
+#include <memory>  // std::unique_ptr
 #include <stdexcept>  // std::invalid_argument
 #include <stdio.h>
 #include <string>
-#include <utility>  // std::pair
 #include <vector>
 
+#include "TrieCore.h"
+#include "utils/key_validation.h"
 
-// #define NODE_SIZE 95  // Allow for 95 printable ASCII characters - from space (32) to tilde (126)
 
-#define SMALLEST_CHAR 0
-#define LARGEST_CHAR 127
-#define NODE_SIZE (LARGEST_CHAR - SMALLEST_CHAR + 1)
-
-
-class SequentialNode {
-
-    friend class SequentialTrie;
-
-    private:
-        std::shared_ptr<SequentialNode> children_[NODE_SIZE];
-        std::shared_ptr<SequentialNode> parent_;
-        bool isEnd_;
-        int numChildren_;
-        int selfIndex_;
-
-    public:
-        SequentialNode();
-};
+// Nodes are owned by their parent alone and are only used by one thread at a time, so the single threaded policy
+// leaves them without locks, atomics or reference counts.
+typedef TrieNode<SingleThreadedPolicy> SequentialNode;
 
 class SequentialTrie {
 
     private:
-        std::shared_ptr<SequentialNode> root_;
+        std::unique_ptr<SequentialNode> root_;
         int size_;
-        int getIndexOfChar(char c);
+        std::vector<SequentialNode*> path_;  // Nodes from the root to the one reached by the last walk, reused by every walk
+        static void checkKey(const std::string& key);
         char getCharForIndex(int idx);
-        void possiblyDeleteNode(std::shared_ptr<SequentialNode> node);
+        SequentialNode* findNode(const std::string& prefix);
+
+        // The parts of TrieCore's writer walks that are particular to this trie - only where they start and how
+        // nodes are created, since nodes are never shared and nothing else is kept up to date
+        struct WalkHooks {
+            SequentialTrie* trie;
+            SequentialNode* root();
+            std::unique_ptr<SequentialNode> newNode(int selfIndex);
+            std::unique_ptr<SequentialNode> copyIfShared(const std::unique_ptr<SequentialNode>&);
+            void linkChanged(SequentialNode*, int, int) {}
+            void adding(const char*, size_t) {}
+            void removing(const char*, size_t) {}
+        };
 
     public:
         SequentialTrie();
+        ~SequentialTrie();
 
         // Basic operations
         void insert(std::string word);
@@ -53,9 +50,11 @@ class SequentialTrie {
         void remove(std::vector<std::string>* words);
         
         int size();
+        void clear();
 
         // Advanced operations
         std::vector<std::string> getStringsWithPrefix(std::string prefix);
         std::vector<std::string> getAllStringsSorted();
-        
+        int countWithPrefix(std::string prefix);
+
 };
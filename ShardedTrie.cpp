@@ -0,0 +1,240 @@
+#include "ShardedTrie.h"
+
+
+ShardWorker::ShardWorker(std::vector<int> cpus) {
+    stopping_ = false;
+    thread_ = std::thread(&ShardWorker::run, this, cpus);
+}
+
+ShardWorker::~ShardWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    hasTask_.notify_one();
+    thread_.join();
+}
+
+void ShardWorker::run(std::vector<int> cpus) {
+
+    pinThreadToCpus(cpus);
+
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (tasks_.empty() && !stopping_) {
+                hasTask_.wait(lock);
+            }
+            if (tasks_.empty()) {
+                return;  // Stopping, and every task has been run
+            }
+            task = tasks_.front();
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+std::future<void> ShardWorker::submit(std::function<void()> task) {
+    // std::function must be copyable, and std::packaged_task is not
+    std::shared_ptr<std::packaged_task<void()>> packaged = std::make_shared<std::packaged_task<void()>>(task);
+    std::future<void> done = packaged->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push([packaged]() { (*packaged)(); });
+    }
+    hasTask_.notify_one();
+    return done;
+}
+
+
+ShardedTrie::ShardedTrie(int numShards) {
+
+    std::vector<NumaNode> nodes = getNumaNodes();
+    if (numShards <= 0) {
+        numShards = nodes.size();
+    }
+
+    shards_.resize(numShards);
+    for (int s = 0; s < numShards; s++) {
+        workers_.push_back(std::make_shared<ShardWorker>(nodes[s % nodes.size()].cpus));
+    }
+
+    // Each shard is created by its own worker, so that its root is allocated on the worker's node as well
+    runOnEveryShard([this, &nodes](int s) {
+        shards_[s] = std::make_shared<ConcurrentTrie>();
+        shards_[s]->setNumThreads(nodes[s % nodes.size()].cpus.size());  // One OpenMP thread per CPU of the node
+    });
+}
+
+int ShardedTrie::numShards() {
+    return shards_.size();
+}
+
+// Returns the shard that holds word. All strings with the same first character are in the same shard,
+// so every non-empty prefix belongs to exactly one shard.
+int ShardedTrie::shardOf(const std::string& word) {
+    if (word.empty()) {
+        return 0;
+    }
+    return (unsigned char) word[0] % shards_.size();
+}
+
+// Returns, for each shard, the indices of the words that belong to it.
+// Throws before anything is changed if any word is invalid, so that no shard is left partly updated.
+std::vector<std::vector<int>> ShardedTrie::partition(std::vector<std::string>* words) {
+    std::vector<std::vector<int>> indices(shards_.size());
+    for (int i = 0; i < words->size(); i++) {
+        const std::string& word = (*words)[i];
+        if (!isKeyInRange(word.data(), word.length(), SMALLEST_CHAR, LARGEST_CHAR)) {
+            throw std::invalid_argument("Invalid character");
+        }
+        indices[shardOf(word)].push_back(i);
+    }
+    return indices;
+}
+
+std::vector<std::vector<std::string>> ShardedTrie::splitWords(std::vector<std::string>* words) {
+    std::vector<std::vector<int>> indices = partition(words);
+    std::vector<std::vector<std::string>> shardWords(shards_.size());
+    for (int s = 0; s < shards_.size(); s++) {
+        shardWords[s].reserve(indices[s].size());
+        for (int i = 0; i < indices[s].size(); i++) {
+            shardWords[s].push_back((*words)[indices[s][i]]);
+        }
+    }
+    return shardWords;
+}
+
+// Runs task(s) for every shard s on that shard's worker, and waits for all of them.
+// If any of them throws, the first exception is rethrown once all of them have finished.
+void ShardedTrie::runOnEveryShard(const std::function<void(int)>& task) {
+    std::vector<std::future<void>> done;
+    for (int s = 0; s < shards_.size(); s++) {
+        done.push_back(workers_[s]->submit([&task, s]() { task(s); }));
+    }
+    std::exception_ptr error = NULL;
+    for (int s = 0; s < done.size(); s++) {
+        try {
+            done[s].get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ShardedTrie::insert(std::string word) {
+    shards_[shardOf(word)]->insert(word);
+}
+
+void ShardedTrie::insert(std::vector<std::string>* words) {
+    std::vector<std::vector<std::string>> shardWords = splitWords(words);
+    runOnEveryShard([this, &shardWords](int s) {
+        if (!shardWords[s].empty()) {
+            shards_[s]->insert(&shardWords[s]);
+        }
+    });
+}
+
+bool ShardedTrie::contains(std::string word) {
+    return shards_[shardOf(word)]->contains(word);
+}
+
+std::vector<bool> ShardedTrie::contains(std::vector<std::string>* words) {
+    std::vector<std::vector<int>> indices = partition(words);
+    std::vector<bool> results(words->size());
+    std::vector<std::vector<bool>> shardResults(shards_.size());
+    runOnEveryShard([this, words, &indices, &shardResults](int s) {
+        if (indices[s].empty()) {
+            return;
+        }
+        std::vector<std::string> shardWords;
+        shardWords.reserve(indices[s].size());
+        for (int i = 0; i < indices[s].size(); i++) {
+            shardWords.push_back((*words)[indices[s][i]]);
+        }
+        shardResults[s] = shards_[s]->contains(&shardWords);
+    });
+    for (int s = 0; s < shards_.size(); s++) {
+        for (int i = 0; i < indices[s].size(); i++) {
+            results[indices[s][i]] = shardResults[s][i];
+        }
+    }
+    return results;
+}
+
+void ShardedTrie::remove(std::string word) {
+    shards_[shardOf(word)]->remove(word);
+}
+
+void ShardedTrie::remove(std::vector<std::string>* words) {
+    std::vector<std::vector<std::string>> shardWords = splitWords(words);
+    runOnEveryShard([this, &shardWords](int s) {
+        if (!shardWords[s].empty()) {
+            shards_[s]->remove(&shardWords[s]);
+        }
+    });
+}
+
+// Removes every string that starts with prefix. Only the shard that owns prefix is touched,
+// unless prefix is empty.
+int ShardedTrie::removePrefix(std::string prefix) {
+    if (!prefix.empty()) {
+        return shards_[shardOf(prefix)]->removePrefix(prefix);
+    }
+    int removed = 0;
+    for (int s = 0; s < shards_.size(); s++) {
+        removed += shards_[s]->removePrefix(prefix);
+    }
+    return removed;
+}
+
+int ShardedTrie::size() {
+    int size = 0;
+    for (int s = 0; s < shards_.size(); s++) {
+        size += shards_[s]->size();
+    }
+    return size;
+}
+
+int ShardedTrie::countWithPrefix(std::string prefix) {
+    if (!prefix.empty()) {
+        return shards_[shardOf(prefix)]->countWithPrefix(prefix);
+    }
+    return size();
+}
+
+std::vector<std::string> ShardedTrie::getStringsWithPrefix(std::string prefix) {
+    if (!prefix.empty()) {
+        return shards_[shardOf(prefix)]->getStringsWithPrefix(prefix);
+    }
+    return getAllStringsSorted();
+}
+
+// Collects the sorted strings of every shard in parallel, then merges them. Each shard holds every string
+// with a given first character, so the merge just takes the run of strings for each first character in turn
+// from the shard that owns it.
+std::vector<std::string> ShardedTrie::getAllStringsSorted() {
+
+    std::vector<std::vector<std::string>> shardStrings(shards_.size());
+    runOnEveryShard([this, &shardStrings](int s) {
+        shardStrings[s] = shards_[s]->getAllStringsSorted();
+    });
+
+    std::vector<std::string> result;
+    std::vector<int> next(shards_.size(), 0);
+    for (int c = SMALLEST_CHAR; c <= LARGEST_CHAR; c++) {
+        int s = c % shards_.size();
+        while (next[s] < shardStrings[s].size() && (unsigned char) shardStrings[s][next[s]][0] == c) {
+            result.push_back(shardStrings[s][next[s]]);
+            next[s]++;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>  // std::exception_ptr
+#include <functional>  // std::function
+#include <future>
+#include <memory>  // std::shared_ptr
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentTrie.h"
+#include "utils/numa_topology.h"
+
+
+// A thread pinned to the CPUs of one NUMA node, which runs the tasks given to it one at a time.
+// Its OpenMP team is created by it, so is pinned to the same CPUs.
+class ShardWorker {
+
+    private:
+        std::thread thread_;
+        std::mutex mutex_;  // Protects the variables below
+        std::condition_variable hasTask_;
+        std::queue<std::function<void()>> tasks_;
+        bool stopping_;
+
+        void run(std::vector<int> cpus);
+
+    public:
+        ShardWorker(std::vector<int> cpus);
+        ~ShardWorker();
+
+        // Runs task on the worker. The future becomes ready when it has finished, and rethrows anything it threw.
+        std::future<void> submit(std::function<void()> task);
+};
+
+// A front end that splits the strings between several independent ConcurrentTrie shards by their first
+// character, with one shard per NUMA node by default. Each shard has its own locks, and its own worker
+// pinned to its node. Bulk operations are split up by shard and run by the shards' workers in parallel,
+// so the nodes they create are allocated on the shard's own node (Linux places memory on the node of the
+// thread that first touches it) and later bulk passes over a shard do not cross sockets.
+// Single-string operations run on the calling thread, to avoid the handoff to a worker.
+class ShardedTrie {
+
+    private:
+        std::vector<std::shared_ptr<ConcurrentTrie>> shards_;
+        std::vector<std::shared_ptr<ShardWorker>> workers_;
+
+        int shardOf(const std::string& word);
+        std::vector<std::vector<int>> partition(std::vector<std::string>* words);
+        std::vector<std::vector<std::string>> splitWords(std::vector<std::string>* words);
+        void runOnEveryShard(const std::function<void(int)>& task);
+
+    public:
+        // Creates numShards shards, spread round-robin over the NUMA nodes (one per node if numShards <= 0).
+        ShardedTrie(int numShards = 0);
+
+        int numShards();
+
+        // Basic operations
+        void insert(std::string word);
+        void insert(std::vector<std::string>* words);
+
+        bool contains(std::string word);
+        std::vector<bool> contains(std::vector<std::string>* words);
+
+        void remove(std::string word);
+        void remove(std::vector<std::string>* words);
+        int removePrefix(std::string prefix);
+
+        int size();
+        int countWithPrefix(std::string prefix);
+
+        // Advanced operations
+        std::vector<std::string> getStringsWithPrefix(std::string prefix);
+        std::vector<std::string> getAllStringsSorted();
+};
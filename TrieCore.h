@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>  // std::min
+#include <atomic>
+#include <memory>  // std::unique_ptr, std::shared_ptr
+#include <omp.h>
+#include <stack>
+#include <string>
+#include <utility>  // std::pair
+#include <vector>
+
+#include "utils/front_coded_block.h"
+
+
+// #define NODE_SIZE 95  // Allow for 95 printable ASCII characters - from space (32) to tilde (126)
+
+#define SMALLEST_CHAR 0
+#define LARGEST_CHAR 127
+#define NODE_SIZE (LARGEST_CHAR - SMALLEST_CHAR + 1)
+
+
+// The node layout and the algorithms that SequentialTrie and ConcurrentTrie share, templated on a synchronisation
+// policy. A policy gives the pointer a node holds its children by, the type of its counters, its lock, and the
+// snapshot epoch it keeps:
+//
+// SingleThreadedPolicy - for a trie used by one thread at a time. Children are owned outright by a unique_ptr,
+// counters are plain ints, and locking and epochs compile away, so its instantiation has no locks, no atomics and
+// no reference counting. Walks refer to nodes by raw pointer.
+//
+// ConcurrentPolicy - for ConcurrentTrie. Children are reference counted, since copies of a node and snapshots share
+// them (see ConcurrentTrie::copyNode()), counters are atomic, and every node has an OpenMP lock. Walks that change
+// the trie hold the nodes they pass by shared_ptr, since another writer may unlink them in the meantime.
+//
+// The walks that insert, remove and look up a string are here too. What differs between the tries - where a
+// writer's walk starts, how nodes are created and copied, and what else has to happen when a string is added or
+// removed - is left to a hooks object that the trie passes in (see TrieCore::insertKey()).
+//
+// A change to the layout or to an algorithm here reaches both tries.
+
+struct SingleThreadedPolicy {
+
+    template <typename T>
+    using Ptr = std::unique_ptr<T>;
+
+    template <typename T>
+    using Ref = T*;
+
+    typedef int Counter;
+
+    struct Lock {
+        inline void lock() {}
+        inline void unlock() {}
+    };
+
+    struct Epoch {};  // No snapshots, so nothing to keep
+
+    // A node's parent is its only owner
+    template <typename T>
+    static inline bool isShared(const Ptr<T>& node) {
+        return false;
+    }
+
+    template <typename T>
+    static inline Ref<T> refTo(const Ptr<T>& node) {
+        return node.get();
+    }
+};
+
+struct ConcurrentPolicy {
+
+    template <typename T>
+    using Ptr = std::shared_ptr<T>;
+
+    template <typename T>
+    using Ref = std::shared_ptr<T>;
+
+    typedef std::atomic<int> Counter;
+
+    class Lock {
+        private:
+            omp_lock_t lock_;
+
+        public:
+            inline Lock() {
+                omp_init_lock(&lock_);
+            }
+            inline ~Lock() {
+                omp_destroy_lock(&lock_);
+            }
+            Lock(const Lock&) = delete;
+            Lock& operator=(const Lock&) = delete;
+
+            inline void lock() {
+                omp_set_lock(&lock_);
+            }
+            inline void unlock() {
+                omp_unset_lock(&lock_);
+            }
+    };
+
+    typedef int Epoch;  // Snapshot epoch of the trie when the node was created
+
+    // Copies of a node and snapshots may still hold the node
+    template <typename T>
+    static inline bool isShared(const Ptr<T>& node) {
+        return node.use_count() != 1;
+    }
+
+    template <typename T>
+    static inline Ref<T> refTo(const Ptr<T>& node) {
+        return node;
+    }
+};
+
+// Nodes never point back up, so that references between them cannot form cycles. Only the tries and TrieCore use
+// the members.
+template <typename Policy>
+class TrieNode {
+
+    public:
+        typedef typename Policy::template Ptr<TrieNode> Ptr;
+
+        Ptr children_[NODE_SIZE];
+        bool isEnd_;
+        bool unlinked_;  // Set once the node has been pruned, after which nothing may be added to it
+        int numChildren_;
+        int selfIndex_;  // Index of the node among its parent's children
+        typename Policy::Counter subtreeSize_;  // Number of strings that end at this node or below it
+        [[no_unique_address]] typename Policy::Epoch epoch_;  // Nodes from older epochs are never modified
+        [[no_unique_address]] typename Policy::Lock nodeLock_;
+
+        inline TrieNode() {
+            isEnd_ = false;
+            unlinked_ = false;
+            numChildren_ = 0;
+            selfIndex_ = -1;
+            subtreeSize_ = 0;
+            epoch_ = typename Policy::Epoch();
+        }
+};
+
+template <typename Policy>
+class TrieCore {
+
+    public:
+        typedef TrieNode<Policy> Node;
+        typedef typename Node::Ptr Ptr;
+        typedef typename Policy::template Ref<Node> Ref;
+
+        // Returns the node reached from node by key, or NULL if there is none. Each link is read under its node's lock.
+        static inline Node* findNode(Node* node, const char* key, size_t length) {
+            for (size_t i = 0; node && i < length; i++) {
+                int index = (unsigned char) key[i] - SMALLEST_CHAR;
+                node->nodeLock_.lock();
+                Node* next = node->children_[index].get();
+                node->nodeLock_.unlock();
+                node = next;
+            }
+            return node;
+        }
+
+        // Returns true if key is a string of the trie, searching from node, which is reached by the part of the key
+        // before key.
+        static inline bool containsKey(Node* node, const char* key, size_t length) {
+            node = findNode(node, key, length);
+            if (node == NULL) {
+                return false;  // If key was in the trie, this would not have been NULL
+            }
+            node->nodeLock_.lock();
+            bool result = node->isEnd_;
+            node->nodeLock_.unlock();
+            return result;
+        }
+
+        // The writers' walks below take a hooks object with these members:
+        //
+        // Ref root() - the root, for a writer to change
+        // Ptr newNode(int selfIndex) - a new empty node
+        // Ptr copyIfShared(const Ptr& node) - a copy of node to link in its place, if something other than its parent
+        //     may still be using it, or NULL to change node itself (copy-on-write)
+        // void linkChanged(Node* node, int depth, int index) - called once child index of node, which is at depth, has
+        //     been linked, replaced or unlinked
+        // void adding(const char* key, size_t length) - called when key is about to be added, under the lock of its node
+        // void removing(const char* key, size_t length) - called when key has been removed, under the lock of its node
+        //
+        // Keys must already have been checked with isKeyInRange().
+
+        // Returns child index of node, which is at depth, for a writer to change: created first if there is none and
+        // create is true, or replaced by hooks.copyIfShared() if that returns a copy. Returns NULL if there is no such
+        // child, or if node has been pruned by another writer since the caller reached it (see pruneEmptyPath()), in
+        // which case writers that add strings have to start again from the root.
+        template <typename Hooks>
+        static inline Ref writableChild(Hooks& hooks, const Ref& node, int depth, int index, bool create) {
+            node->nodeLock_.lock();
+                if (node->unlinked_) {
+                    node->nodeLock_.unlock();
+                    return nullptr;
+                }
+                bool linkChanged = false;
+                if (!node->children_[index] && create) {
+                    node->children_[index] = hooks.newNode(index);
+                    node->numChildren_++;
+                    linkChanged = true;
+                } else if (node->children_[index]) {
+                    Ptr copy = hooks.copyIfShared(node->children_[index]);
+                    if (copy) {
+                        node->children_[index] = std::move(copy);
+                        linkChanged = true;
+                    }
+                }
+                Ref child = Policy::refTo(node->children_[index]);
+            node->nodeLock_.unlock();
+            if (linkChanged) {
+                hooks.linkChanged(std::to_address(node), depth, index);
+            }
+            return child;
+        }
+
+        // Adds key to the trie, creating the nodes it needs, and returns true if it was not there already. path is
+        // left holding the nodes from the root to the key's node, whose subtree sizes have been counted.
+        // The key's node is checked and marked under its lock, so that only one of several writers adding the same key
+        // counts it, and so that hooks.adding() sees the changes to a key in the order they happened. If a remover
+        // prunes a node on the path before the key is added below it, the walk starts again from the root.
+        template <typename Hooks>
+        static inline bool insertKey(Hooks& hooks, const char* key, size_t length, std::vector<Ref>& path) {
+
+            Ref cur = nullptr;
+            while (!cur) {
+                path.clear();
+                cur = hooks.root();
+                path.push_back(cur);
+                for (size_t i = 0; cur && i < length; i++) {
+                    int index = (unsigned char) key[i] - SMALLEST_CHAR;
+                    cur = writableChild(hooks, cur, i, index, true);
+                    path.push_back(cur);
+                }
+                if (cur) {
+                    cur->nodeLock_.lock();  // Kept until the key is added, so that cur cannot be pruned first
+                    if (cur->unlinked_) {
+                        cur->nodeLock_.unlock();
+                        cur = nullptr;
+                    }
+                }
+            }
+
+            bool added = !cur->isEnd_;
+            if (added) {
+                hooks.adding(key, length);  // Before the key can be found
+            }
+            cur->isEnd_ = true;
+            cur->nodeLock_.unlock();
+
+            if (added) {
+                for (size_t i = 0; i < path.size(); i++) {
+                    path[i]->subtreeSize_++;
+                }
+            }
+            return added;
+        }
+
+        // Removes key from the trie and returns true if it was there, pruning the nodes that no longer lead to any
+        // string. path is left holding the nodes from the root to the key's node, or as far as the key goes.
+        template <typename Hooks>
+        static inline bool removeKey(Hooks& hooks, const char* key, size_t length, std::vector<Ref>& path) {
+
+            path.clear();
+            Ref cur = hooks.root();
+            path.push_back(cur);
+            for (size_t i = 0; i < length; i++) {
+                int index = (unsigned char) key[i] - SMALLEST_CHAR;
+                cur = writableChild(hooks, cur, i, index, false);
+                if (!cur) {
+                    return false;
+                }
+                path.push_back(cur);
+            }
+
+            // Checked and unset under the lock, so that only one of several writers removing the same key counts it
+            cur->nodeLock_.lock();
+                bool removed = cur->isEnd_;
+                cur->isEnd_ = false;
+                if (removed) {
+                    hooks.removing(key, length);
+                }
+            cur->nodeLock_.unlock();
+            if (!removed) {
+                return false;
+            }
+
+            for (size_t i = 0; i < path.size(); i++) {
+                path[i]->subtreeSize_--;
+            }
+            pruneEmptyPath(path, [&hooks](Node* parent, int depth, int index) {
+                hooks.linkChanged(parent, depth, index);
+            });
+            return true;
+        }
+
+        // Calls visit(string, shared) for every string in the subtree of node, which is reached by prefix, in sorted
+        // order. shared is the length of the prefix that the string shares with the one visited before it. The walk
+        // keeps one path string and an explicit stack, so that long strings cannot overflow the call stack and no
+        // string is built on its own. The subtree must not change during the walk.
+        template <typename Visitor>
+        static inline void forEachString(const Node* node, const std::string& prefix, Visitor visit) {
+
+            if (node == NULL) {
+                return;
+            }
+
+            std::string path = prefix;
+            size_t shared = 0;  // Length of the prefix that path shares with the last string visited
+            std::vector<std::pair<const Node*, int>> stack;  // Nodes on the path, and the next child of each to visit
+            stack.push_back(std::make_pair(node, 0));
+            if (node->isEnd_) {
+                visit(path, (size_t) 0);
+                shared = path.length();
+            }
+
+            while (!stack.empty()) {
+                const Node* cur = stack.back().first;
+                int next = stack.back().second;
+                while (next < NODE_SIZE && !cur->children_[next]) {
+                    next++;
+                }
+                if (next == NODE_SIZE) {
+                    stack.pop_back();
+                    if (!stack.empty()) {
+                        path.pop_back();
+                        shared = std::min(shared, path.length());
+                    }
+                    continue;
+                }
+
+                stack.back().second = next + 1;
+                const Node* child = cur->children_[next].get();
+                path.push_back((char) (next + SMALLEST_CHAR));
+                stack.push_back(std::make_pair(child, 0));
+                if (child->isEnd_) {
+                    visit(path, shared);
+                    shared = path.length();
+                }
+            }
+        }
+
+        // Appends the strings in the subtree of node, which is reached by prefix, to strings in sorted order
+        static inline void appendStrings(const Node* node, const std::string& prefix, std::vector<std::string>& strings) {
+            forEachString(node, prefix, [&strings](const std::string& string, size_t shared) {
+                strings.push_back(string);
+            });
+        }
+
+        // Appends the strings in the subtree of node, which is reached by prefix, to block in sorted order
+        static inline void frontCode(const Node* node, const std::string& prefix, FrontCodedBlock& block) {
+            forEachString(node, prefix, [&block](const std::string& string, size_t shared) {
+                block.append(shared, string.data() + shared, string.length() - shared);
+            });
+        }
+
+        // Called with the path from the root to the node of a string that was just removed. Unlinks the nodes at the
+        // end of the path that no longer lead to any string, stopping at the root, and calls
+        // onUnlink(parent, depth of parent, index) for each one. For instance, if our set has "beta" and "be", and we
+        // remove "beta", the "a" and "t" nodes are unlinked.
+        // With ConcurrentPolicy other writers may be holding the node. It is only unlinked if, with both its parent's
+        // lock and its own held, it is still empty and still its parent's child, and it is marked unlinked_ under its
+        // own lock, so that a writer that adds to it afterwards sees the mark and starts again (see tryUnlinkChild()).
+        template <typename OnUnlink>
+        static inline void pruneEmptyPath(std::vector<Ref>& path, OnUnlink onUnlink) {
+
+            for (int depth = path.size() - 1; depth > 0; depth--) {  // We don't want to delete the root at depth 0
+
+                Node* parent = std::to_address(path[depth - 1]);
+                int index = path[depth]->selfIndex_;
+                if (!tryUnlinkChild(parent, std::to_address(path[depth]), index)) {
+                    return;  // Still a prefix of a string, a string itself, or already unlinked by another writer
+                }
+                onUnlink(parent, depth - 1, index);
+            }
+        }
+
+        // Unlinks child index of parent if it is node, and node has no children and is not the end of a string, and
+        // marks it unlinked_. Returns true if it was unlinked. The parent's lock is taken before the child's - the
+        // order of every writer that holds two node locks.
+        static inline bool tryUnlinkChild(Node* parent, Node* node, int index) {
+            parent->nodeLock_.lock();
+            node->nodeLock_.lock();
+                bool unlink = parent->children_[index].get() == node && node->numChildren_ == 0 && !node->isEnd_;
+                if (unlink) {
+                    node->unlinked_ = true;
+                }
+            node->nodeLock_.unlock();
+            if (unlink) {
+                parent->children_[index] = nullptr;  // With ConcurrentPolicy the caller still holds node
+                parent->numChildren_--;
+            }
+            parent->nodeLock_.unlock();
+            return unlink;
+        }
+
+        // Frees node and everything below it one node at a time rather than through recursive destructors, so that
+        // long chains cannot overflow the stack. Nodes that are still shared are left to their other owners.
+        static inline void freeSubtree(Ptr node) {
+            std::stack<Ptr> stack;
+            if (node) {
+                stack.push(std::move(node));
+            }
+            while (!stack.empty()) {
+                Ptr cur = std::move(stack.top());
+                stack.pop();
+                if (Policy::isShared(cur)) {
+                    continue;  // Only our reference is dropped
+                }
+                for (int i = 0; i < NODE_SIZE; i++) {
+                    if (cur->children_[i]) {
+                        stack.push(std::move(cur->children_[i]));
+                    }
+                }
+            }  // cur has no children left by the time it is freed
+        }
+};
@@ -0,0 +1,155 @@
+#include "TrieScanner.h"
+
+#include <algorithm>  // std::min, std::max
+#include <omp.h>
+
+
+TrieScanner::TrieScanner(std::vector<int> edgeStart, std::vector<char> edgeChars, std::vector<int> edgeTargets, std::vector<int> keyLength,
+                         std::shared_ptr<ExecutionContext> context) {
+
+    edgeStart_ = edgeStart;
+    edgeChars_ = edgeChars;
+    edgeTargets_ = edgeTargets;
+    keyLength_ = keyLength;
+    context_ = context;
+
+    int numStates = keyLength_.size();
+    fail_ = std::vector<int>(numStates, 0);
+    output_ = std::vector<int>(numStates, -1);
+
+    numKeys_ = 0;
+    maxKeyLength_ = 0;
+    for (int s = 0; s < numStates; s++) {
+        if (keyLength_[s] > 0) {
+            numKeys_++;
+            maxKeyLength_ = std::max(maxKeyLength_, keyLength_[s]);
+        }
+    }
+
+    // Missing edges out of the root lead back to the root
+    rootNext_ = std::vector<int>(128, 0);
+    for (int e = edgeStart_[0]; e < edgeStart_[1]; e++) {
+        rootNext_[(unsigned char) edgeChars_[e]] = edgeTargets_[e];
+    }
+
+    // States are numbered in breadth-first order, so every state is processed after all shallower states,
+    // whose failure and output links are the only ones needed here.
+    for (int s = 0; s < numStates; s++) {
+        for (int e = edgeStart_[s]; e < edgeStart_[s + 1]; e++) {
+            int target = edgeTargets_[e];
+            fail_[target] = (s == 0) ? 0 : nextState(fail_[s], edgeChars_[e]);
+            int suffix = fail_[target];
+            output_[target] = (keyLength_[suffix] > 0) ? suffix : output_[suffix];
+        }
+    }
+}
+
+// Returns the target of the goto edge out of state labelled c, or -1 if there is none.
+int TrieScanner::findEdge(int state, char c) const {
+    int lo = edgeStart_[state];
+    int hi = edgeStart_[state + 1];
+    while (lo < hi) {  // Edges are sorted by character
+        int mid = (lo + hi) / 2;
+        if (edgeChars_[mid] < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < edgeStart_[state + 1] && edgeChars_[lo] == c) {
+        return edgeTargets_[lo];
+    }
+    return -1;
+}
+
+// Returns the state reached from state after reading c, following failure links where there is no edge.
+int TrieScanner::nextState(int state, char c) const {
+    int idx = (unsigned char) c;
+    if (idx >= 128) {
+        return 0;  // Not a valid key character, so no key can span it
+    }
+    while (state != 0) {
+        int target = findEdge(state, c);
+        if (target != -1) {
+            return target;
+        }
+        state = fail_[state];
+    }
+    return rootNext_[idx];
+}
+
+// Runs the automaton over text[begin, end), reporting only the occurrences that end at or after reportFrom.
+void TrieScanner::scanRange(const char* text, size_t begin, size_t end, size_t reportFrom, std::vector<ScanMatch>& matches) const {
+    int state = 0;
+    for (size_t i = begin; i < end; i++) {
+        state = nextState(state, text[i]);
+        if (i < reportFrom) {
+            continue;
+        }
+        if (keyLength_[state] > 0) {
+            matches.push_back(ScanMatch{i + 1 - keyLength_[state], (size_t) keyLength_[state]});
+        }
+        for (int o = output_[state]; o != -1; o = output_[o]) {
+            matches.push_back(ScanMatch{i + 1 - keyLength_[o], (size_t) keyLength_[o]});
+        }
+    }
+}
+
+std::vector<ScanMatch> TrieScanner::scan(const std::string& text) const {
+    return scan(text.data(), text.length());
+}
+
+std::vector<ScanMatch> TrieScanner::scan(const char* text, size_t length) const {
+
+    std::vector<ScanMatch> matches;
+    if (numKeys_ == 0) {
+        return matches;
+    }
+
+    int numChunks = context_->threadsFor(length);
+    if (numChunks <= 1) {
+        scanRange(text, 0, length, 0, matches);
+        return matches;
+    }
+
+    // Split the text into one chunk per thread. Each chunk starts scanning maxKeyLength_ - 1 characters early,
+    // so that the automaton is in the right state by the time it reaches the chunk, but only reports the
+    // occurrences that end inside its own chunk. Concatenating the chunks in order then gives the same
+    // result as a sequential scan.
+    size_t chunkSize = (length + numChunks - 1) / numChunks;
+    std::vector<std::vector<ScanMatch>> chunkMatches(numChunks);
+
+    double startTime = omp_get_wtime();
+    #pragma omp parallel for num_threads(numChunks) if(numChunks > 1) schedule(static, 1)
+    for (int k = 0; k < numChunks; k++) {
+        size_t chunkBegin = std::min(length, k * chunkSize);
+        size_t chunkEnd = std::min(length, chunkBegin + chunkSize);
+        size_t overlap = std::min(chunkBegin, (size_t) (maxKeyLength_ - 1));
+        scanRange(text, chunkBegin - overlap, chunkEnd, chunkBegin, chunkMatches[k]);
+    }
+    context_->record(length, numChunks, omp_get_wtime() - startTime);
+
+    for (int k = 0; k < numChunks; k++) {
+        matches.insert(matches.end(), chunkMatches[k].begin(), chunkMatches[k].end());
+    }
+    return matches;
+}
+
+bool TrieScanner::containsAny(const std::string& text) const {
+    int state = 0;
+    for (size_t i = 0; i < text.length(); i++) {
+        state = nextState(state, text[i]);
+        if (keyLength_[state] > 0 || output_[state] != -1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TrieScanner::numKeys() const {
+    return numKeys_;
+}
+
+int TrieScanner::numStates() const {
+    return keyLength_.size();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>  // std::shared_ptr
+#include <stddef.h>  // size_t
+#include <string>
+#include <vector>
+
+#include "utils/execution_context.h"
+
+
+// A single occurrence of a key inside a scanned text.
+struct ScanMatch {
+    size_t start;  // Offset of the first character of the occurrence
+    size_t length;  // Length of the key that occurs there
+};
+
+// An immutable Aho-Corasick automaton over a fixed set of keys, produced by ConcurrentTrie::compileScanner().
+// It finds every occurrence of every key inside a text in a single pass over the text.
+// Since it never changes after construction, it may be shared and used by any number of threads at once.
+class TrieScanner {
+
+    private:
+        // Goto edges of the underlying trie in compressed row form - the edges of state s are
+        // edgeChars_/edgeTargets_[edgeStart_[s] .. edgeStart_[s + 1]), sorted by character.
+        // State 0 is the root, and states are numbered in breadth-first order.
+        std::vector<int> edgeStart_;
+        std::vector<char> edgeChars_;
+        std::vector<int> edgeTargets_;
+
+        std::vector<int> keyLength_;  // Length of the key ending at each state, 0 if no key ends there
+        std::vector<int> fail_;  // Longest proper suffix of each state that is also a state
+        std::vector<int> output_;  // Nearest state along the failure chain (excluding itself) where a key ends, -1 if none
+        std::vector<int> rootNext_;  // Full transition table for the root, indexed by character
+
+        int numKeys_;
+        int maxKeyLength_;
+
+        std::shared_ptr<ExecutionContext> context_;  // The scanner's own, for scanning long texts in parallel
+
+        int findEdge(int state, char c) const;
+        int nextState(int state, char c) const;
+        void scanRange(const char* text, size_t begin, size_t end, size_t reportFrom, std::vector<ScanMatch>& matches) const;
+
+    public:
+        TrieScanner(std::vector<int> edgeStart, std::vector<char> edgeChars, std::vector<int> edgeTargets, std::vector<int> keyLength,
+                    std::shared_ptr<ExecutionContext> context);
+
+        // Returns every occurrence of every key in text, ordered by end position and then by decreasing length.
+        // Texts long enough to pay for the threads (see utils/execution_context.h) are split into chunks that are
+        // scanned in parallel, within the thread budget that the trie had when the scanner was compiled.
+        std::vector<ScanMatch> scan(const std::string& text) const;
+        std::vector<ScanMatch> scan(const char* text, size_t length) const;
+
+        // Returns true if any key occurs in text, stopping at the first occurrence.
+        bool containsAny(const std::string& text) const;
+
+        int numKeys() const;
+        int numStates() const;
+};
@@ -1,11 +1,18 @@
+#include <coroutine>
 #include <fstream>
+#include <future>
 #include <random>
+#include <set>
+#include <stdlib.h>  // mkdtemp
 #include <string>
 #include <unordered_set>
 #include <vector>
 
+#include "AsyncTrie.h"
 #include "ConcurrentTrie.h"
 #include "SequentialTrie.h"
+#include "ShardedTrie.h"
+#include "utils/word_list.h"
 
 
 #define IS_TRUE(x) { if (!(x)) printf("%s failed on line %d\n", __FUNCTION__, __LINE__); }
@@ -207,6 +214,1064 @@ void testGetWordsSorted() {
 
 }
 
+void testSnapshot() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"a", "be", "bet", "beta", "c"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie.snapshot();
+
+    concurrentTrie.remove("bet");
+    concurrentTrie.insert("bets");
+    concurrentTrie.insert("d");
+    concurrentTrie.removePrefix("c");
+
+    // The snapshot still sees the trie as it was
+    IS_TRUE(snapshot->getAllStringsSorted() == words);
+    IS_TRUE(snapshot->size() == 5);
+    IS_TRUE(snapshot->contains("bet"));
+    IS_FALSE(snapshot->contains("bets"));
+    IS_TRUE(snapshot->countWithPrefix("be") == 3);
+    IS_TRUE(snapshot->getStringsWithPrefix("c") == std::vector<std::string>({"c"}));
+
+    // While the trie itself has moved on
+    std::vector<std::string> expected = {"a", "be", "beta", "bets", "d"};
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == expected);
+    IS_TRUE(concurrentTrie.size() == 5);
+    IS_TRUE(concurrentTrie.countWithPrefix("be") == 3);
+    IS_FALSE(concurrentTrie.contains("bet"));
+    IS_FALSE(concurrentTrie.contains("c"));
+
+    // A second snapshot taken without writes in between sees the same version
+    std::shared_ptr<TrieSnapshot> snapshot2 = concurrentTrie.snapshot();
+    std::shared_ptr<TrieSnapshot> snapshot3 = concurrentTrie.snapshot();
+    concurrentTrie.remove("a");
+    IS_TRUE(snapshot2->getAllStringsSorted() == expected);
+    IS_TRUE(snapshot3->getAllStringsSorted() == expected);
+    IS_FALSE(concurrentTrie.contains("a"));
+
+    // Nodes emptied after a snapshot are still pruned from the trie
+    concurrentTrie.remove("d");
+    IS_TRUE(concurrentTrie.countWithPrefix("d") == 0);
+    IS_TRUE(concurrentTrie.getStringsWithPrefix("d").empty());
+
+}
+
+void testRemovePrefix() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"https://www.facebook.com", "https://www.facebook.com/groups", "https://www.fb.com",
+                                      "https://www.google.com", "https://www.youtube.com"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    IS_TRUE(concurrentTrie.removePrefix("https://www.f") == 3);
+    IS_TRUE(concurrentTrie.size() == 2);
+    IS_TRUE(concurrentTrie.countWithPrefix("https://") == 2);
+    IS_FALSE(concurrentTrie.contains("https://www.facebook.com"));
+    IS_FALSE(concurrentTrie.contains("https://www.fb.com"));
+    IS_TRUE(concurrentTrie.contains("https://www.google.com"));
+
+    IS_TRUE(concurrentTrie.removePrefix("https://www.f") == 0);
+    IS_TRUE(concurrentTrie.removePrefix("ftp://") == 0);
+
+    // The last string under a branch takes the now empty branch with it
+    IS_TRUE(concurrentTrie.removePrefix("https://www.google.com") == 1);
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == std::vector<std::string>({"https://www.youtube.com"}));
+    IS_TRUE(concurrentTrie.rank("https://www.youtube.com") == 0);
+
+    // An empty prefix removes everything
+    concurrentTrie.insert("a");
+    IS_TRUE(concurrentTrie.removePrefix("") == 2);
+    IS_TRUE(concurrentTrie.size() == 0);
+    IS_TRUE(concurrentTrie.getAllStringsSorted().empty());
+
+    concurrentTrie.insert("https://www.facebook.com");
+    IS_TRUE(concurrentTrie.contains("https://www.facebook.com"));
+    IS_TRUE(concurrentTrie.size() == 1);
+
+}
+
+void testClear() {
+
+    ConcurrentTrie concurrentTrie;
+    std::vector<std::string> words = {"apple", "apples", "banana", "cherry"};
+    concurrentTrie.insert(&words);
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie.snapshot();
+
+    concurrentTrie.clear();
+    IS_TRUE(concurrentTrie.size() == 0);
+    IS_TRUE(concurrentTrie.getAllStringsSorted().empty());
+    IS_FALSE(concurrentTrie.contains("apple"));
+    IS_TRUE(snapshot->getAllStringsSorted() == words);  // The snapshot keeps the nodes it shares
+
+    concurrentTrie.insert("banana");
+    IS_TRUE(concurrentTrie.contains("banana"));
+    IS_TRUE(concurrentTrie.size() == 1);
+
+    // A long chain is freed without recursion
+    concurrentTrie.insert(std::string(10000, 'a'));
+    concurrentTrie.clear();
+    IS_TRUE(concurrentTrie.size() == 0);
+
+    SequentialTrie sequentialTrie;
+    sequentialTrie.insert(&words);
+    sequentialTrie.clear();
+    IS_TRUE(sequentialTrie.size() == 0);
+    IS_FALSE(sequentialTrie.contains("apple"));
+    sequentialTrie.insert("apple");
+    IS_TRUE(sequentialTrie.contains("apple"));
+
+}
+
+void testCountWithPrefix() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"a", "be", "bet", "beta", "c"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+    concurrentTrie.insert("bet");  // Duplicates are not counted twice
+
+    IS_TRUE(concurrentTrie.countWithPrefix("") == 5);
+    IS_TRUE(concurrentTrie.countWithPrefix("b") == 3);
+    IS_TRUE(concurrentTrie.countWithPrefix("bet") == 2);
+    IS_TRUE(concurrentTrie.countWithPrefix("beta") == 1);
+    IS_TRUE(concurrentTrie.countWithPrefix("betas") == 0);
+    IS_TRUE(concurrentTrie.countWithPrefix("x") == 0);
+
+    concurrentTrie.remove("bet");
+    concurrentTrie.remove("bet");  // Removing a missing word does not change the counts
+    IS_TRUE(concurrentTrie.countWithPrefix("b") == 2);
+    IS_TRUE(concurrentTrie.countWithPrefix("bet") == 1);
+    IS_TRUE(concurrentTrie.countWithPrefix("") == concurrentTrie.size());
+
+}
+
+void testRangeRankSelect() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"a", "be", "bet", "beta", "c", "cat"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    std::vector<std::string> expected = {"be", "bet", "beta"};
+    IS_TRUE(concurrentTrie.range("b", "c") == expected);
+    expected = {"bet", "beta", "c"};
+    IS_TRUE(concurrentTrie.range("bet", "ca") == expected);
+    expected = {"bet", "beta", "c", "cat"};
+    IS_TRUE(concurrentTrie.range("bes", "") == expected);
+    expected = {"beta", "c", "cat"};
+    IS_TRUE(concurrentTrie.range("bet!", "") == expected);
+    expected = {"bet", "beta"};
+    IS_TRUE(concurrentTrie.range("bet", "", 2) == expected);
+    IS_TRUE(concurrentTrie.range("", "") == words);
+    IS_TRUE(concurrentTrie.range("c", "b").empty());
+    IS_TRUE(concurrentTrie.range("d", "").empty());
+
+    IS_TRUE(concurrentTrie.rank("") == 0);
+    IS_TRUE(concurrentTrie.rank("a") == 0);
+    IS_TRUE(concurrentTrie.rank("b") == 1);
+    IS_TRUE(concurrentTrie.rank("bet") == 2);
+    IS_TRUE(concurrentTrie.rank("betz") == 4);
+    IS_TRUE(concurrentTrie.rank("zzz") == 6);
+
+    for (int i = 0; i < words.size(); i++) {
+        IS_TRUE(concurrentTrie.select(i) == words[i]);
+        IS_TRUE(concurrentTrie.rank(words[i]) == i);
+    }
+
+    bool threw = false;
+    try {
+        concurrentTrie.select(words.size());
+    } catch (std::out_of_range& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+
+}
+
+void testSetOperations() {
+
+    std::vector<std::string> wordsA = {"a", "be", "bet", "beta", "cat"};
+    std::vector<std::string> wordsB = {"be", "beta", "bets", "cat", "dog"};
+
+    ConcurrentTrie unionTrie, intersectTrie, differenceTrie, trieB;
+    unionTrie.insert(&wordsA);
+    intersectTrie.insert(&wordsA);
+    differenceTrie.insert(&wordsA);
+    trieB.insert(&wordsB);
+
+    unionTrie.unionWith(trieB);
+    std::vector<std::string> expected = {"a", "be", "bet", "beta", "bets", "cat", "dog"};
+    IS_TRUE(unionTrie.getAllStringsSorted() == expected);
+    IS_TRUE(unionTrie.size() == expected.size());
+
+    intersectTrie.intersect(trieB);
+    expected = {"be", "beta", "cat"};
+    IS_TRUE(intersectTrie.getAllStringsSorted() == expected);
+    IS_TRUE(intersectTrie.size() == expected.size());
+    IS_FALSE(intersectTrie.contains("bet"));
+    IS_FALSE(intersectTrie.contains("a"));
+
+    differenceTrie.difference(trieB);
+    expected = {"a", "bet"};
+    IS_TRUE(differenceTrie.getAllStringsSorted() == expected);
+    IS_TRUE(differenceTrie.size() == expected.size());
+    IS_FALSE(differenceTrie.contains("be"));
+
+    // The other trie is left untouched
+    IS_TRUE(trieB.getAllStringsSorted() == wordsB);
+    IS_TRUE(trieB.size() == wordsB.size());
+
+    // Operations of a trie with itself
+    unionTrie.unionWith(unionTrie);
+    IS_TRUE(unionTrie.size() == 7);
+    unionTrie.intersect(unionTrie);
+    IS_TRUE(unionTrie.size() == 7);
+    unionTrie.difference(unionTrie);
+    IS_TRUE(unionTrie.size() == 0);
+    IS_TRUE(unionTrie.getAllStringsSorted().empty());
+
+    // Nodes emptied by a set operation are pruned, so the trie can be refilled
+    unionTrie.insert("bet");
+    IS_TRUE(unionTrie.getAllStringsSorted() == std::vector<std::string>({"bet"}));
+
+}
+
+void testLongestPrefixOf() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"https://www.facebook.com", "https://www.facebook.com/groups", "https://www.google.com", "https"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    IS_TRUE(concurrentTrie.longestPrefixOf("https://www.facebook.com/groups/123") == "https://www.facebook.com/groups");
+    IS_TRUE(concurrentTrie.longestPrefixOf("https://www.facebook.com/pages") == "https://www.facebook.com");
+    IS_TRUE(concurrentTrie.longestPrefixOf("https://www.google.com") == "https://www.google.com");
+    IS_TRUE(concurrentTrie.longestPrefixOf("https://www.twitter.com") == "https");
+    IS_TRUE(concurrentTrie.longestPrefixOf("http://www.google.com") == "");
+    IS_TRUE(concurrentTrie.longestPrefixOf("") == "");
+
+    std::vector<std::string> expected = {"https", "https://www.facebook.com", "https://www.facebook.com/groups"};
+    IS_TRUE(concurrentTrie.allPrefixesOf("https://www.facebook.com/groups/123") == expected);
+    IS_TRUE(concurrentTrie.allPrefixesOf("ftp://").empty());
+
+}
+
+void testFuzzySearch() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"bat", "be", "bed", "bet", "beta", "cat", "zebra"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    std::vector<std::string> expected = {"bat", "be", "bed", "bet", "beta"};
+    IS_TRUE(concurrentTrie.fuzzySearch("bet", 1) == expected);
+
+    expected = {"bet"};
+    IS_TRUE(concurrentTrie.fuzzySearch("bet", 0) == expected);
+
+    IS_TRUE(concurrentTrie.fuzzySearch("xyz", 1).empty());
+    IS_TRUE(concurrentTrie.fuzzySearch("bet", -1).empty());
+
+}
+
+void testMatch() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"a", "be", "bed", "bet", "beta", "cat", "cot", "zebra"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+
+    std::vector<std::string> expected = {"bed", "bet"};
+    IS_TRUE(concurrentTrie.match("be?") == expected);
+
+    expected = {"be", "bed", "bet", "beta"};
+    IS_TRUE(concurrentTrie.match("be*") == expected);
+
+    expected = {"cat", "cot"};
+    IS_TRUE(concurrentTrie.match("c[a-o]t") == expected);
+
+    expected = {"bet", "cat", "cot"};
+    IS_TRUE(concurrentTrie.match("*t") == expected);
+
+    expected = {"bed"};
+    IS_TRUE(concurrentTrie.match("be[^t]") == expected);
+
+    IS_TRUE(concurrentTrie.match("*") == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(concurrentTrie.match("x*").empty());
+
+    // Streaming stops as soon as the callback returns false
+    std::vector<std::string> streamed;
+    concurrentTrie.match("*", [&streamed](const std::string& word) {
+        streamed.push_back(word);
+        return streamed.size() < 3;
+    });
+    expected = {"a", "be", "bed"};
+    IS_TRUE(streamed == expected);
+
+}
+
+void testScanner() {
+
+    ConcurrentTrie concurrentTrie;
+
+    std::vector<std::string> words = {"he", "she", "his", "hers"};
+    for (std::string word : words) {
+        concurrentTrie.insert(word);
+    }
+    std::shared_ptr<TrieScanner> scanner = concurrentTrie.compileScanner();
+    IS_TRUE(scanner->numKeys() == 4);
+
+    // Later changes to the trie do not affect the scanner
+    concurrentTrie.insert("us");
+
+    std::vector<ScanMatch> matches = scanner->scan("ushers");
+    IS_TRUE(matches.size() == 3);
+    if (matches.size() == 3) {
+        IS_TRUE(matches[0].start == 1 && matches[0].length == 3);  // she
+        IS_TRUE(matches[1].start == 2 && matches[1].length == 2);  // he
+        IS_TRUE(matches[2].start == 2 && matches[2].length == 4);  // hers
+    }
+
+    IS_TRUE(scanner->containsAny("this"));
+    IS_FALSE(scanner->containsAny("usual"));
+    IS_TRUE(scanner->scan("").empty());
+
+}
+
+// Returns a new empty directory for a durable trie to keep its files in.
+std::string makeTempDirectory() {
+    char directory[] = "/tmp/trietest.XXXXXX";
+    return mkdtemp(directory);
+}
+
+void removeDirectory(std::string directory) {
+    system(("rm -rf " + directory).c_str());
+}
+
+void testDurability() {
+
+    std::string directory = makeTempDirectory();
+
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 0);
+        std::vector<std::string> words = {"car", "cart", "carbon", "dog", "dot"};
+        concurrentTrie.insert(&words);
+        concurrentTrie.remove("cart");
+        concurrentTrie.checkpoint();
+        concurrentTrie.insert("door");
+        IS_TRUE(concurrentTrie.removePrefix("car") == 2);
+        concurrentTrie.insert("cat");
+    }
+
+    // Recovery loads the checkpoint and replays the changes logged after it
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 0);
+        IS_TRUE(concurrentTrie.getAllStringsSorted() == std::vector<std::string>({"cat", "dog", "door", "dot"}));
+        IS_TRUE(concurrentTrie.size() == 4);
+        IS_TRUE(concurrentTrie.countWithPrefix("do") == 3);
+
+        ConcurrentTrie other;
+        other.insert("cat");
+        other.insert("dog");
+        concurrentTrie.intersect(other);
+    }
+
+    // A record torn by a crash is dropped, and what is logged after it is still recovered
+    {
+        std::ofstream segment(directory + "/log.00000000000000000001", std::ios::binary);
+        segment << "torn";
+    }
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 0);
+        IS_TRUE(concurrentTrie.getAllStringsSorted() == std::vector<std::string>({"cat", "dog"}));
+        concurrentTrie.insert("cow");
+    }
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 0);
+        IS_TRUE(concurrentTrie.getAllStringsSorted() == std::vector<std::string>({"cat", "cow", "dog"}));
+    }
+
+    removeDirectory(directory);
+}
+
+void testInsertFromFile() {
+
+    std::string directory = makeTempDirectory();
+    std::string filepath = directory + "/words.txt";
+
+    // Enough lines for every thread to get a chunk, with an empty line, an invalid one and no final newline
+    std::vector<std::string> lines = {"apple", "", "banana", "caf\xc3\xa9", "apple"};
+    for (int i = 0; i < 5000; i++) {
+        lines.push_back("w" + std::to_string(i));
+    }
+    lines.push_back("last");
+    {
+        std::ofstream file(filepath, std::ios::binary);
+        for (int i = 0; i < lines.size(); i++) {
+            file << lines[i] << (i + 1 < lines.size() ? "\n" : "");
+        }
+    }
+
+    SequentialTrie sequentialTrie;
+    for (std::string line : lines) {
+        if (!line.empty() && line.find('\xc3') == std::string::npos) {
+            sequentialTrie.insert(line);
+        }
+    }
+
+    ConcurrentTrie concurrentTrie;
+    IS_TRUE(concurrentTrie.insertFromFile(filepath) == lines.size() - 2);  // Without the empty and the invalid line
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == sequentialTrie.getAllStringsSorted());
+    IS_FALSE(concurrentTrie.contains(""));
+
+    ConcurrentTrie firstLines;
+    IS_TRUE(firstLines.insertFromFile(filepath, 3) == 2);
+    IS_TRUE(firstLines.getAllStringsSorted() == std::vector<std::string>({"apple", "banana"}));
+
+    IS_TRUE(loadWords(filepath, 3) == std::vector<std::string>({"apple", "", "banana"}));
+    IS_TRUE(loadWords(directory + "/missing.txt", 0).empty());
+
+    removeDirectory(directory);
+}
+
+void testKeyValidation() {
+
+    // An invalid byte at every position of keys long enough for the vector kernels and their tails
+    for (int length = 1; length <= 80; length++) {
+        std::string key(length, 'a');
+        IS_TRUE(isKeyInRange(key.data(), key.length(), SMALLEST_CHAR, LARGEST_CHAR));
+        for (int i = 0; i < length; i++) {
+            key[i] = '\x80';
+            IS_FALSE(isKeyInRange(key.data(), key.length(), SMALLEST_CHAR, LARGEST_CHAR));
+            key[i] = 'a';
+        }
+    }
+    IS_TRUE(isKeyInRange("", 0, SMALLEST_CHAR, LARGEST_CHAR));
+    IS_TRUE(isKeyInRange("abcdefghijklmnopqrstuvwxyz", 26, 'a', 'z'));
+    IS_FALSE(isKeyInRange("abcdefghijklmnopqrstuvwxyz{", 27, 'a', 'z'));
+    IS_FALSE(isKeyInRange("`abcdefghijklmnopqrstuvwxyz", 27, 'a', 'z'));
+
+    ConcurrentTrie concurrentTrie;
+    bool found = true;
+
+    IS_TRUE(concurrentTrie.tryInsert("apple") == STATUS_OK);
+    IS_TRUE(concurrentTrie.tryContains("apple", &found) == STATUS_OK);
+    IS_TRUE(found);
+
+    // Invalid keys are rejected before any node is created
+    IS_TRUE(concurrentTrie.tryInsert("ban\xe9na") == STATUS_INVALID_KEY);
+    IS_TRUE(concurrentTrie.countWithPrefix("ban") == 0);
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == std::vector<std::string>({"apple"}));
+    IS_TRUE(concurrentTrie.tryContains("ban\xe9na", &found) == STATUS_INVALID_KEY);
+    IS_TRUE(concurrentTrie.tryRemove("appl\xe9") == STATUS_INVALID_KEY);
+    IS_TRUE(concurrentTrie.size() == 1);
+
+    bool threw = false;
+    try {
+        concurrentTrie.insert("ban\xe9na");
+    } catch (std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+
+    // Lookups and prefix queries report invalid keys the same way
+    int numThrown = 0;
+    try {
+        concurrentTrie.fuzzySearch("appl\xe9", 1);
+    } catch (std::invalid_argument& e) {
+        numThrown++;
+    }
+    try {
+        concurrentTrie.getStringsWithPrefix("\xe9");
+    } catch (std::invalid_argument& e) {
+        numThrown++;
+    }
+    try {
+        concurrentTrie.snapshot()->contains("ban\xe9na");
+    } catch (std::invalid_argument& e) {
+        numThrown++;
+    }
+    IS_TRUE(numThrown == 3);
+
+    // As are they by SequentialTrie, whose walks are the same
+    SequentialTrie sequentialTrie;
+    threw = false;
+    try {
+        sequentialTrie.insert("ban\xe9na");
+    } catch (std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+    IS_TRUE(sequentialTrie.countWithPrefix("ban") == 0);
+
+    // A bulk insert with one invalid key inserts nothing
+    std::vector<std::string> words = {"banana", "cherry", "dat\xe9"};
+    threw = false;
+    try {
+        concurrentTrie.insert(&words);
+    } catch (std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+    IS_TRUE(concurrentTrie.size() == 1);
+
+    IS_TRUE(concurrentTrie.tryRemove("apple") == STATUS_OK);
+    IS_TRUE(concurrentTrie.size() == 0);
+
+}
+
+void testShardedTrie() {
+
+    ShardedTrie shardedTrie(3);
+    IS_TRUE(shardedTrie.numShards() == 3);
+
+    std::vector<std::string> words = {"apple", "apply", "banana", "band", "cherry", "date", "Zebra", "~tilde"};
+    shardedTrie.insert(&words);
+    shardedTrie.insert("apricot");
+
+    std::vector<std::string> sorted = words;
+    sorted.push_back("apricot");
+    std::sort(sorted.begin(), sorted.end());
+    IS_TRUE(shardedTrie.getAllStringsSorted() == sorted);
+    IS_TRUE(shardedTrie.size() == 9);
+
+    IS_TRUE(shardedTrie.contains("band"));
+    IS_FALSE(shardedTrie.contains("ban"));
+    std::vector<std::string> queries = {"date", "dates", "Zebra", "apple", ""};
+    IS_TRUE(shardedTrie.contains(&queries) == std::vector<bool>({true, false, true, true, false}));
+
+    IS_TRUE(shardedTrie.countWithPrefix("ap") == 3);
+    IS_TRUE(shardedTrie.getStringsWithPrefix("ban") == std::vector<std::string>({"banana", "band"}));
+    IS_TRUE(shardedTrie.removePrefix("ap") == 3);
+
+    std::vector<std::string> toRemove = {"banana", "date"};
+    shardedTrie.remove(&toRemove);
+    shardedTrie.remove("cherry");
+    IS_TRUE(shardedTrie.getAllStringsSorted() == std::vector<std::string>({"Zebra", "band", "~tilde"}));
+
+    // A bulk insert with one invalid key leaves every shard unchanged
+    std::vector<std::string> invalid = {"kiwi", "lim\xe9"};
+    bool threw = false;
+    try {
+        shardedTrie.insert(&invalid);
+    } catch (std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+    IS_FALSE(shardedTrie.contains("kiwi"));
+
+    IS_TRUE(shardedTrie.removePrefix("") == 3);
+    IS_TRUE(shardedTrie.size() == 0);
+
+}
+
+void testFilter() {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert("apple");
+    concurrentTrie.enableFilter(1 << 16, 0.01);  // Picks up the strings already there
+
+    FilterStats stats = concurrentTrie.filterStats();
+    IS_TRUE(stats.memoryBytes == 1 << 16);
+    IS_TRUE(stats.numHashes == 7);
+    IS_TRUE(stats.capacity > 1000);
+    IS_TRUE(stats.falsePositiveRate < 0.01);
+
+    IS_TRUE(concurrentTrie.contains("apple"));
+    IS_FALSE(concurrentTrie.contains("apples"));
+
+    concurrentTrie.insert("apples");
+    concurrentTrie.insert("banana");
+    IS_TRUE(concurrentTrie.contains("apples"));
+    concurrentTrie.remove("apple");
+    IS_FALSE(concurrentTrie.contains("apple"));
+    IS_TRUE(concurrentTrie.contains("apples"));
+
+    // Set operations keep the filter up to date too
+    ConcurrentTrie other;
+    std::vector<std::string> otherWords = {"banana", "cherry", "cherries", "date"};
+    other.insert(&otherWords);
+    concurrentTrie.unionWith(other);
+    for (std::string word : otherWords) {
+        IS_TRUE(concurrentTrie.contains(word));
+    }
+    concurrentTrie.intersect(other);
+    IS_FALSE(concurrentTrie.contains("apples"));
+    IS_TRUE(concurrentTrie.contains("cherries"));
+
+    concurrentTrie.removePrefix("cherr");
+    IS_FALSE(concurrentTrie.contains("cherry"));
+    concurrentTrie.insert("cherry");
+    IS_TRUE(concurrentTrie.contains("cherry"));
+
+    ConcurrentTrie noFilter;
+    bool threw = false;
+    try {
+        noFilter.filterStats();
+    } catch (std::logic_error& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+
+}
+
+void testJumpTable() {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.enableJumpTable();
+
+    std::vector<std::string> words = {"a", "ab", "abc", "abd", "b", "bcd", "cde"};
+    concurrentTrie.insert(&words);
+    for (std::string word : words) {
+        IS_TRUE(concurrentTrie.contains(word));
+    }
+    IS_FALSE(concurrentTrie.contains("ac"));
+    IS_FALSE(concurrentTrie.contains("abe"));
+    IS_TRUE(concurrentTrie.countWithPrefix("ab") == 3);
+
+    // Entries that were looked up while absent, and entries for nodes that have since been replaced or removed
+    concurrentTrie.insert("ac");
+    IS_TRUE(concurrentTrie.contains("ac"));
+    concurrentTrie.remove("bcd");
+    IS_FALSE(concurrentTrie.contains("bcd"));
+    concurrentTrie.insert("bcd");
+    IS_TRUE(concurrentTrie.contains("bcd"));
+
+    // Writers copy nodes that a snapshot shares
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie.snapshot();
+    concurrentTrie.insert("abz");
+    concurrentTrie.remove("abc");
+    IS_TRUE(concurrentTrie.contains("abz"));
+    IS_FALSE(concurrentTrie.contains("abc"));
+    IS_TRUE(snapshot->contains("abc"));
+    IS_TRUE(concurrentTrie.countWithPrefix("ab") == 3);
+
+    concurrentTrie.removePrefix("ab");
+    IS_FALSE(concurrentTrie.contains("abd"));
+    IS_TRUE(concurrentTrie.countWithPrefix("ab") == 0);
+    concurrentTrie.removePrefix("c");
+    IS_FALSE(concurrentTrie.contains("cde"));
+    concurrentTrie.insert("cde");
+    IS_TRUE(concurrentTrie.contains("cde"));
+
+    ConcurrentTrie other;
+    std::vector<std::string> otherWords = {"ab", "bcd", "cdf", "de"};
+    other.insert(&otherWords);
+    concurrentTrie.unionWith(other);
+    IS_TRUE(concurrentTrie.contains("cdf"));
+    IS_TRUE(concurrentTrie.contains("de"));
+    concurrentTrie.intersect(other);
+    IS_FALSE(concurrentTrie.contains("cde"));
+    IS_TRUE(concurrentTrie.contains("bcd"));
+    concurrentTrie.difference(other);
+    IS_FALSE(concurrentTrie.contains("bcd"));
+    IS_FALSE(concurrentTrie.contains("de"));
+    IS_TRUE(concurrentTrie.size() == 0);
+
+    concurrentTrie.removePrefix("");
+    concurrentTrie.insert("ab");
+    IS_TRUE(concurrentTrie.contains("ab"));
+
+}
+
+// A coroutine that starts straight away, whose end a plain thread can wait for
+struct TestCoroutine {
+    struct promise_type {
+        std::promise<void> finished;
+        TestCoroutine get_return_object() { return TestCoroutine{finished.get_future()}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { finished.set_value(); }
+        void unhandled_exception() { finished.set_exception(std::current_exception()); }
+    };
+    std::future<void> finished;
+};
+
+TestCoroutine useAsyncTrie(AsyncTrie& asyncTrie) {
+
+    std::vector<std::string> words = {"apple", "apples", "application", "banana"};
+    std::vector<std::string> lookups = {"apple", "cherry", "banana"};
+    std::vector<std::string> toRemove = {"apple", "banana"};
+    std::vector<std::string> invalid = {"caf\xc3\xa9"};
+
+    co_await asyncTrie.insert(words);
+    std::vector<bool> found = co_await asyncTrie.contains(lookups);
+    IS_TRUE(found == std::vector<bool>({true, false, true}));
+    IS_TRUE(co_await asyncTrie.countWithPrefix("app") == 3);
+    std::vector<std::string> withPrefix = co_await asyncTrie.getStringsWithPrefix("apple");
+    IS_TRUE(withPrefix == std::vector<std::string>({"apple", "apples"}));
+
+    co_await asyncTrie.remove(toRemove);
+    IS_FALSE(asyncTrie.trie()->contains("apple"));
+    IS_TRUE(asyncTrie.trie()->size() == 2);
+
+    // Errors are rethrown in the coroutine
+    bool threw = false;
+    try {
+        co_await asyncTrie.insert(invalid);
+    } catch (std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+}
+
+void testAsyncTrie() {
+
+    std::shared_ptr<ConcurrentTrie> concurrentTrie = std::make_shared<ConcurrentTrie>();
+    AsyncTrie asyncTrie(concurrentTrie);
+    useAsyncTrie(asyncTrie).finished.get();
+
+    // Several coroutines waiting at once
+    std::vector<std::future<void>> finished;
+    for (int i = 0; i < 4; i++) {
+        finished.push_back(useAsyncTrie(asyncTrie).finished);
+    }
+    for (int i = 0; i < finished.size(); i++) {
+        finished[i].get();
+    }
+    IS_TRUE(concurrentTrie->size() == 2);
+
+    // With a resume executor of the caller's, coroutines continue on its thread
+    ThreadPool resumer(1);
+    std::promise<std::thread::id> resumerThread;
+    resumer.submit([&resumerThread]() {
+        resumerThread.set_value(std::this_thread::get_id());
+    });
+    std::thread::id expected = resumerThread.get_future().get();
+    AsyncTrie resumedTrie(concurrentTrie, 1, &resumer);
+    std::promise<std::thread::id> continuedOn;
+    [](AsyncTrie& trie, std::promise<std::thread::id>& continuedOn) -> TestCoroutine {
+        co_await trie.countWithPrefix("app");
+        continuedOn.set_value(std::this_thread::get_id());
+    }(resumedTrie, continuedOn);
+    IS_TRUE(continuedOn.get_future().get() == expected);
+
+}
+
+void testExecutionContext() {
+
+    // Tiny batches run sequentially, large ones get the whole budget
+    ExecutionContext context(4);
+    IS_TRUE(context.threadsFor(0) == 1);
+    IS_TRUE(context.threadsFor(10 * KEY_OVERHEAD) == 1);
+    IS_TRUE(context.threadsFor(1LL << 40) == 4);
+    context.setMaxThreads(1);
+    IS_TRUE(context.threadsFor(1LL << 40) == 1);
+    context.setMaxThreads(0);
+    IS_TRUE(context.maxThreads() == 1);
+
+    // Tries with different budgets do not change each other's, or the caller's
+    int ompThreads = omp_get_max_threads();
+    ConcurrentTrie sequentialTrie;
+    sequentialTrie.setNumThreads(1);
+    ConcurrentTrie parallelTrie;
+    parallelTrie.setNumThreads(4);
+    IS_TRUE(omp_get_max_threads() == ompThreads);
+
+    std::vector<std::string> words = {"a", "to", "tea", "ted", "ten", "i", "in", "inn", "abc", "xyz"};
+    sequentialTrie.insert(&words);
+    parallelTrie.insert(&words);
+    std::vector<bool> sequentialResults = sequentialTrie.contains(&words);
+    std::vector<bool> parallelResults = parallelTrie.contains(&words);
+    for (int i = 0; i < words.size(); i++) {
+        IS_TRUE(sequentialResults[i]);
+        IS_TRUE(parallelResults[i]);
+    }
+    IS_TRUE(sequentialTrie.getAllStringsSorted() == parallelTrie.getAllStringsSorted());
+
+    sequentialTrie.remove(&words);
+    parallelTrie.remove(&words);
+    IS_TRUE(sequentialTrie.size() == 0);
+    IS_TRUE(parallelTrie.size() == 0);
+}
+
+void testPackedBatches() {
+
+    std::string data = "toteatedteninn";
+    std::vector<size_t> offsets = {0, 2, 5, 8, 11, 12, 14};  // to, tea, ted, ten, i, nn
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert(data, offsets);
+    IS_TRUE(concurrentTrie.size() == 6);
+    IS_TRUE(concurrentTrie.contains("ted"));
+    IS_TRUE(concurrentTrie.contains("nn"));
+    IS_TRUE(!concurrentTrie.contains("te"));
+
+    std::string queries = "teatedtixyzi";
+    std::vector<size_t> queryOffsets = {0, 3, 6, 8, 11, 12};  // tea, ted, ti, xyz, i
+    std::vector<uint8_t> results(5);
+    concurrentTrie.contains(queries, queryOffsets, results);
+    IS_TRUE(results == std::vector<uint8_t>({1, 1, 0, 0, 1}));
+
+    std::vector<uint64_t> bits = {1ULL << 63};  // Bits past the last key are left alone
+    concurrentTrie.contains(queries, queryOffsets, bits);
+    IS_TRUE(bits[0] == ((1ULL << 63) | 0b10011));
+
+    // Results too small, offsets out of order or past the end, or an invalid key: nothing is changed
+    bool threw = false;
+    try {
+        std::vector<uint8_t> tooFew(4);
+        concurrentTrie.contains(queries, queryOffsets, tooFew);
+    } catch (const std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+    std::vector<size_t> badOffsets[] = {{0, 3, 2, 8}, {0, 3, 20}};
+    for (std::vector<size_t>& bad : badOffsets) {
+        threw = false;
+        try {
+            concurrentTrie.remove(queries, bad);
+        } catch (const std::invalid_argument& e) {
+            threw = true;
+        }
+        IS_TRUE(threw);
+    }
+    std::string invalid = "tea\x80";
+    std::vector<size_t> invalidOffsets = {0, 3, 4};
+    threw = false;
+    try {
+        concurrentTrie.remove(invalid, invalidOffsets);
+    } catch (const std::invalid_argument& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+    IS_TRUE(concurrentTrie.size() == 6);
+
+    concurrentTrie.remove(data, offsets);
+    IS_TRUE(concurrentTrie.size() == 0);
+
+    // No keys at all
+    std::vector<size_t> noOffsets;
+    concurrentTrie.insert(data, noOffsets);
+    IS_TRUE(concurrentTrie.size() == 0);
+}
+
+void testFrontCodedBlock() {
+
+    FrontCodedBlock block;
+    std::vector<std::string> strings = {"", "tea", "team", "ted", "ten", "to", std::string(200, 'x')};
+    for (int i = 0; i < strings.size(); i++) {
+        block.append(strings[i]);
+    }
+    IS_TRUE(block.size() == strings.size());
+    IS_TRUE(block.toVector() == strings);
+
+    // Read straight from the wire bytes
+    std::string wire(block.bytes().data(), block.bytes().size());
+    FrontCodedReader reader(wire.data(), wire.size());
+    int i = 0;
+    for (const std::string& string : reader) {
+        IS_TRUE(i < strings.size() && string == strings[i]);
+        i++;
+    }
+    IS_TRUE(i == strings.size());
+
+    // Truncated, or sharing more than the string before it had
+    std::string malformed[] = {wire.substr(0, wire.size() - 1), std::string("\x05\x01a", 3), std::string("\x80", 1)};
+    for (const std::string& bytes : malformed) {
+        bool threw = false;
+        try {
+            FrontCodedReader badReader(bytes.data(), bytes.size());
+            for (FrontCodedReader::Iterator it = badReader.begin(); it != badReader.end(); ++it) {}
+        } catch (const std::invalid_argument& e) {
+            threw = true;
+        }
+        IS_TRUE(threw);
+    }
+
+    ConcurrentTrie concurrentTrie;
+    std::vector<std::string> words = {"te", "tea", "ted", "ten", "to", "inn", "i"};
+    concurrentTrie.insert(&words);
+    IS_TRUE(concurrentTrie.getStringsWithPrefixFrontCoded("te").toVector() == concurrentTrie.getStringsWithPrefix("te"));
+    IS_TRUE(concurrentTrie.getStringsWithPrefixFrontCoded("").toVector() == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(concurrentTrie.getStringsWithPrefixFrontCoded("x").empty());
+}
+
+void testMinimize() {
+
+    ConcurrentTrie concurrentTrie;
+    std::vector<std::string> words = {"tap", "taps", "top", "tops"};
+    concurrentTrie.insert(&words);
+
+    // "ta" and "to" have the same endings, and so do "tap" and "top"
+    std::shared_ptr<Dawg> dawg = concurrentTrie.minimize();
+    IS_TRUE(dawg->size() == 4);
+    IS_TRUE(dawg->numStates() == 5);
+    IS_TRUE(dawg->numEdges() == 5);
+    IS_TRUE(dawg->contains("tops"));
+    IS_TRUE(!dawg->contains("to"));
+    IS_TRUE(!dawg->contains("tapss"));
+    IS_TRUE(dawg->getAllStringsSorted() == words);
+    IS_TRUE(dawg->getStringsWithPrefix("to") == std::vector<std::string>({"top", "tops"}));
+    IS_TRUE(dawg->getStringsWithPrefix("x").empty());
+
+    for (int i = 0; i < words.size(); i++) {
+        IS_TRUE(dawg->ordinal(words[i]) == i);
+        IS_TRUE(dawg->keyAt(i) == words[i]);
+    }
+    IS_TRUE(dawg->ordinal("to") == -1);
+    bool threw = false;
+    try {
+        dawg->keyAt(4);
+    } catch (const std::out_of_range& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+
+    // Later changes to the trie do not affect it
+    concurrentTrie.insert("tea");
+    IS_TRUE(!dawg->contains("tea"));
+
+    ConcurrentTrie emptyTrie;
+    IS_TRUE(emptyTrie.minimize()->size() == 0);
+    IS_TRUE(emptyTrie.minimize()->getAllStringsSorted().empty());
+}
+
+void testSequentialSharesCore() {
+
+    SequentialTrie sequentialTrie;
+    ConcurrentTrie concurrentTrie;
+    std::vector<std::string> words = {"be", "beta", "bet", "a"};
+    sequentialTrie.insert(&words);
+    concurrentTrie.insert(&words);
+
+    IS_TRUE(sequentialTrie.countWithPrefix("be") == 3);
+    IS_TRUE(sequentialTrie.countWithPrefix("") == 4);
+    IS_TRUE(sequentialTrie.countWithPrefix("c") == 0);
+    IS_TRUE(sequentialTrie.getAllStringsSorted() == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(sequentialTrie.getStringsWithPrefix("bet") == std::vector<std::string>({"bet", "beta"}));
+
+    // Removing "beta" and "bet" prunes the "t" and "a" nodes, leaving "be" a leaf
+    sequentialTrie.remove("beta");
+    sequentialTrie.remove("bet");
+    IS_TRUE(sequentialTrie.countWithPrefix("be") == 1);
+    IS_TRUE(sequentialTrie.getStringsWithPrefix("bet").empty());
+    sequentialTrie.insert("beta");
+    IS_TRUE(sequentialTrie.countWithPrefix("bet") == 1);
+
+    // A long chain is freed without recursing once per node
+    std::string chain(200000, 'z');
+    sequentialTrie.insert(chain);
+    IS_TRUE(sequentialTrie.countWithPrefix("zzz") == 1);
+    sequentialTrie.remove(chain);
+    IS_TRUE(sequentialTrie.countWithPrefix("z") == 0);
+    sequentialTrie.insert(chain);
+    sequentialTrie.clear();
+    IS_TRUE(sequentialTrie.size() == 0);
+}
+
+// Applies the changes in changeSet to replica, a copy of the trie's strings
+void applyChanges(const ChangeSet& changeSet, std::set<std::string>& replica) {
+    for (const ChangeEvent& change : changeSet.changes) {
+        if (change.op == CHANGE_INSERT) {
+            replica.insert(change.key);
+        } else if (change.op == CHANGE_REMOVE) {
+            replica.erase(change.key);
+        } else {
+            std::set<std::string>::iterator it = replica.lower_bound(change.key);
+            while (it != replica.end() && it->compare(0, change.key.length(), change.key) == 0) {
+                it = replica.erase(it);
+            }
+        }
+    }
+}
+
+void testChangeStream() {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert("old");  // Before the stream, so part of version 0
+    concurrentTrie.enableChangeStream(4);
+    IS_TRUE(concurrentTrie.version() == 0);
+
+    concurrentTrie.insert("tap");
+    concurrentTrie.insert("tap");  // Not a change
+    concurrentTrie.insert("top");
+    concurrentTrie.remove("tap");
+    concurrentTrie.remove("absent");  // Not a change
+    IS_TRUE(concurrentTrie.version() == 3);
+
+    ChangeSet changeSet = concurrentTrie.changesSince(0);
+    IS_FALSE(changeSet.resyncNeeded);
+    IS_TRUE(changeSet.version == 3);
+    IS_TRUE(changeSet.changes.size() == 3);
+    IS_TRUE(changeSet.changes[0].op == CHANGE_INSERT && changeSet.changes[0].key == "tap" && changeSet.changes[0].version == 1);
+    IS_TRUE(changeSet.changes[2].op == CHANGE_REMOVE && changeSet.changes[2].key == "tap" && changeSet.changes[2].version == 3);
+    IS_TRUE(concurrentTrie.changesSince(3).changes.empty());
+    IS_FALSE(concurrentTrie.changesSince(3).resyncNeeded);
+    IS_TRUE(concurrentTrie.changesSince(4).resyncNeeded);  // From the future
+
+    // Only the last 4 changes are kept
+    concurrentTrie.insert("a");
+    concurrentTrie.insert("b");
+    concurrentTrie.removePrefix("t");
+    IS_TRUE(concurrentTrie.changesSince(1).resyncNeeded);
+    changeSet = concurrentTrie.changesSince(2);
+    IS_FALSE(changeSet.resyncNeeded);
+    IS_TRUE(changeSet.changes.size() == 4);
+    IS_TRUE(changeSet.changes.back().op == CHANGE_REMOVE_PREFIX && changeSet.changes.back().key == "t");
+
+    // A snapshot holds every change up to its version
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie.snapshot();
+    IS_TRUE(snapshot->version() == 6);
+    std::vector<std::string> strings = snapshot->getAllStringsSorted();
+    std::set<std::string> replica(strings.begin(), strings.end());
+    concurrentTrie.insert("tea");
+    concurrentTrie.clear();
+    applyChanges(concurrentTrie.changesSince(snapshot->version()), replica);
+    IS_TRUE(replica.empty());
+
+    // Set operations change strings that are not known individually
+    ConcurrentTrie other;
+    other.insert("x");
+    concurrentTrie.unionWith(other);
+    IS_TRUE(concurrentTrie.version() == 9);
+    IS_TRUE(concurrentTrie.changesSince(8).resyncNeeded);
+    IS_FALSE(concurrentTrie.changesSince(9).resyncNeeded);
+
+    // With durability on, changes carry their log records, and are durable once read
+    std::string directory = makeTempDirectory();
+    {
+        ConcurrentTrie durableTrie;
+        durableTrie.enableDurability(directory, 0);
+        durableTrie.enableChangeStream(4);
+        durableTrie.insert("tap");
+        durableTrie.removePrefix("t");
+        changeSet = durableTrie.changesSince(0);
+        IS_TRUE(changeSet.changes.size() == 2);
+        IS_TRUE(changeSet.changes[0].lsn > 0 && changeSet.changes[1].lsn > changeSet.changes[0].lsn);
+    }
+    removeDirectory(directory);
+
+    bool threw = false;
+    try {
+        other.changesSince(0);
+    } catch (const std::logic_error& e) {
+        threw = true;
+    }
+    IS_TRUE(threw);
+}
+
 void basicTests() {
 
     testBasicInsertAndContains();
@@ -217,6 +1282,30 @@ void basicTests() {
 
     testGetWordsWithPrefix();
     testGetWordsSorted();
+
+    testCountWithPrefix();
+    testSnapshot();
+    testRemovePrefix();
+    testClear();
+    testRangeRankSelect();
+    testSetOperations();
+    testLongestPrefixOf();
+    testFuzzySearch();
+    testMatch();
+    testScanner();
+    testDurability();
+    testInsertFromFile();
+    testKeyValidation();
+    testShardedTrie();
+    testFilter();
+    testJumpTable();
+    testAsyncTrie();
+    testExecutionContext();
+    testPackedBatches();
+    testFrontCodedBlock();
+    testMinimize();
+    testSequentialSharesCore();
+    testChangeStream();
 }
 
 void testMultipleInsert(std::vector<std::string> wordList) {
@@ -282,6 +1371,11 @@ void testMultipleRemove(std::vector<std::string> wordList) {
         IS_FALSE(concurrentTrie.contains(word));
     }
 
+    // Check that the subtree counters agree with the strings that are left
+    for (std::string prefix : {"", "a", "b", "co", "th"}) {
+        IS_TRUE(concurrentTrie.countWithPrefix(prefix) == concurrentTrie.getStringsWithPrefix(prefix).size());
+    }
+
 }
 
 
@@ -313,40 +1407,659 @@ void testAsyncRemove(std::vector<std::string> wordList) {
 }
 
 
-void concurrentTests(std::vector<std::string> wordList) {
+int editDistance(const std::string& a, const std::string& b) {
+    std::vector<int> prev(b.length() + 1), cur(b.length() + 1);
+    for (int j = 0; j <= b.length(); j++) prev[j] = j;
+    for (int i = 1; i <= a.length(); i++) {
+        cur[0] = i;
+        for (int j = 1; j <= b.length(); j++) {
+            cur[j] = std::min(std::min(cur[j - 1] + 1, prev[j] + 1), prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1));
+        }
+        std::swap(prev, cur);
+    }
+    return prev[b.length()];
+}
 
-    testMultipleInsert(wordList);
-    testMultipleContains(wordList);
-    testMultipleRemove(wordList);
+// Compares fuzzySearch against a brute force scan of the word list
+void testFuzzySearchMatchesBruteForce(std::vector<std::string> wordList) {
 
-    testAsyncInsert(wordList);
-    testAsyncRemove(wordList);
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert(&wordList);
+
+    std::vector<std::string> queries = {"tset", "apple", "concurent"};
+    if (!wordList.empty()) queries.push_back(wordList[0]);
+
+    for (std::string query : queries) {
+        for (int maxDistance = 0; maxDistance <= 2; maxDistance++) {
+            std::vector<std::string> expected;
+            for (std::string word : wordList) {
+                if (editDistance(query, word) <= maxDistance) {
+                    expected.push_back(word);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+            IS_TRUE(concurrentTrie.fuzzySearch(query, maxDistance) == expected);
+        }
+    }
+}
+
+
+// Checks the scanner against a brute force search on a short text,
+// and checks that scanning a long text in parallel chunks gives the same result as a single pass.
+void testScannerMatchesBruteForce(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    std::vector<std::string> keys(wordList.begin(), wordList.begin() + std::min((size_t) 200, wordList.size()));
+    concurrentTrie.insert(&keys);
+    std::shared_ptr<TrieScanner> scanner = concurrentTrie.compileScanner();
+
+    std::string text;
+    for (std::string word : wordList) {
+        text += word;
+        text += ' ';
+        if (text.length() > 20000) break;
+    }
+
+    std::vector<ScanMatch> matches = scanner->scan(text);
+    std::vector<std::string> allKeys = concurrentTrie.getAllStringsSorted();
+    int expected = 0;
+    for (size_t start = 0; start < text.length() && start <= 2000; start++) {
+        for (std::string key : allKeys) {
+            if (text.compare(start, key.length(), key) == 0) expected++;
+        }
+    }
+    int found = 0;
+    for (ScanMatch match : matches) {
+        if (match.start <= 2000) found++;
+        IS_TRUE(concurrentTrie.contains(text.substr(match.start, match.length)));
+    }
+    IS_TRUE(found == expected);
+
+    // Long enough to be split into chunks. The scanner uses the trie's thread budget.
+    std::string longText;
+    while (longText.length() < (1 << 21)) longText += text;
+
+    concurrentTrie.setNumThreads(1);
+    std::vector<ScanMatch> sequential = scanner->scan(longText);
+    concurrentTrie.setNumThreads(4);
+    std::vector<ScanMatch> parallel = scanner->scan(longText);
+
+    IS_TRUE(sequential.size() == parallel.size());
+    for (size_t i = 0; i < std::min(sequential.size(), parallel.size()); i++) {
+        IS_TRUE(sequential[i].start == parallel[i].start && sequential[i].length == parallel[i].length);
+        if (sequential[i].start != parallel[i].start) break;
+    }
+}
+
+
+// Checks the set operations against std::set_union/std::set_intersection/std::set_difference on two random halves
+void testSetOperationsOnWordList(std::vector<std::string> wordList) {
+
+    std::vector<std::string> wordsA, wordsB;
+    for (std::string word : wordList) {
+        if (rand() % 2 == 0) wordsA.push_back(word);
+        if (rand() % 2 == 0) wordsB.push_back(word);
+    }
+
+    ConcurrentTrie unionTrie, intersectTrie, differenceTrie, trieB;
+    unionTrie.insert(&wordsA);
+    intersectTrie.insert(&wordsA);
+    differenceTrie.insert(&wordsA);
+    trieB.insert(&wordsB);
+
+    std::vector<std::string> sortedA = unionTrie.getAllStringsSorted();
+    std::vector<std::string> sortedB = trieB.getAllStringsSorted();
+    std::vector<std::string> expectedUnion, expectedIntersection, expectedDifference;
+    std::set_union(sortedA.begin(), sortedA.end(), sortedB.begin(), sortedB.end(), std::back_inserter(expectedUnion));
+    std::set_intersection(sortedA.begin(), sortedA.end(), sortedB.begin(), sortedB.end(), std::back_inserter(expectedIntersection));
+    std::set_difference(sortedA.begin(), sortedA.end(), sortedB.begin(), sortedB.end(), std::back_inserter(expectedDifference));
+
+    unionTrie.unionWith(trieB);
+    intersectTrie.intersect(trieB);
+    differenceTrie.difference(trieB);
+
+    IS_TRUE(unionTrie.getAllStringsSorted() == expectedUnion);
+    IS_TRUE(unionTrie.size() == expectedUnion.size());
+    IS_TRUE(intersectTrie.getAllStringsSorted() == expectedIntersection);
+    IS_TRUE(intersectTrie.size() == expectedIntersection.size());
+    IS_TRUE(differenceTrie.getAllStringsSorted() == expectedDifference);
+    IS_TRUE(differenceTrie.size() == expectedDifference.size());
+    IS_TRUE(trieB.getAllStringsSorted() == sortedB);
+
+    // Subtree counters are kept up to date by the set operations
+    for (std::string prefix : {"", "a", "b", "co", "th"}) {
+        IS_TRUE(unionTrie.countWithPrefix(prefix) == unionTrie.getStringsWithPrefix(prefix).size());
+        IS_TRUE(intersectTrie.countWithPrefix(prefix) == intersectTrie.getStringsWithPrefix(prefix).size());
+        IS_TRUE(differenceTrie.countWithPrefix(prefix) == differenceTrie.getStringsWithPrefix(prefix).size());
+    }
+}
+
+
+// Pages through the sorted word list with select and range, and checks rank against the sorted list
+void testPagination(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert(&wordList);
+    std::vector<std::string> sorted = concurrentTrie.getAllStringsSorted();
+
+    int pageSize = 97;
+    for (int start = 0; start < sorted.size(); start += pageSize) {
+        std::string first = concurrentTrie.select(start);
+        IS_TRUE(first == sorted[start]);
+        std::vector<std::string> page = concurrentTrie.range(first, "", pageSize);
+        int end = std::min((int) sorted.size(), start + pageSize);
+        IS_TRUE(page == std::vector<std::string>(sorted.begin() + start, sorted.begin() + end));
+        IS_TRUE(concurrentTrie.rank(first) == start);
+    }
+}
+
+
+// Reads a snapshot while another thread keeps removing words from the trie
+void testSnapshotWithConcurrentWriter(std::vector<std::string> wordList) {
+
+    std::shared_ptr<ConcurrentTrie> concurrentTrie = std::make_shared<ConcurrentTrie>();
+    concurrentTrie->insert(&wordList);
+
+    std::vector<std::string> before = concurrentTrie->getAllStringsSorted();
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie->snapshot();
+
+    std::thread writer([concurrentTrie, &wordList]() {
+        for (std::string word : wordList) {
+            concurrentTrie->remove(word);
+        }
+    });
+    for (int i = 0; i < 5; i++) {
+        IS_TRUE(snapshot->getAllStringsSorted() == before);
+    }
+    writer.join();
+
+    IS_TRUE(snapshot->getAllStringsSorted() == before);
+    IS_TRUE(snapshot->size() == before.size());
+    IS_TRUE(concurrentTrie->size() == 0);
+    IS_TRUE(concurrentTrie->getAllStringsSorted().empty());
+}
+
+// Removes words from several threads while others insert words that share their prefixes, so that removers keep
+// pruning the nodes that inserters are adding below. No insert may be lost, and the counts must stay exact.
+void testPruneWithConcurrentInserts(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.setNumThreads(4);
+    std::vector<std::string> kept;
+    std::vector<std::string> churned;
+    for (int i = 0; i < wordList.size() && i < 20000; i++) {
+        (i % 2 == 0 ? kept : churned).push_back(wordList[i]);
+    }
+
+    #pragma omp parallel num_threads(4)
+    {
+        int t = omp_get_thread_num();
+        for (int i = t / 2; i < kept.size(); i += 2) {
+            if (t % 2 == 0) {
+                concurrentTrie.insert(kept[i]);  // Inserted once and kept
+            } else {
+                concurrentTrie.insert(churned[i % churned.size()] + "\x7f");
+                concurrentTrie.remove(churned[i % churned.size()] + "\x7f");  // Prunes the chain back to a shared prefix
+            }
+        }
+    }
+
+    std::unordered_set<std::string> keptSet(kept.begin(), kept.end());
+    for (std::string word : kept) {
+        IS_TRUE(concurrentTrie.contains(word));
+    }
+    IS_TRUE(concurrentTrie.size() == keptSet.size());
+    IS_TRUE(concurrentTrie.countWithPrefix("") == keptSet.size());
+    IS_TRUE(concurrentTrie.getAllStringsSorted().size() == keptSet.size());
+}
+
+// Inserts words under a prefix from several threads while another keeps removing the prefix, so that inserts land in
+// subtrees as they are unlinked. The counts must match the strings that are left, and so must the recovered log.
+void testRemovePrefixWithConcurrentInserts(std::vector<std::string> wordList) {
+
+    std::string directory = makeTempDirectory();
+    std::vector<std::string> left;
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 0);
+        #pragma omp parallel num_threads(4)
+        {
+            int t = omp_get_thread_num();
+            if (t == 0) {
+                for (int round = 0; round < 20; round++) {
+                    concurrentTrie.removePrefix("pfx/");
+                }
+            } else {
+                for (int i = t - 1; i < wordList.size(); i += 3) {
+                    concurrentTrie.insert("pfx/" + wordList[i]);
+                }
+            }
+        }
+
+        left = concurrentTrie.getAllStringsSorted();
+        IS_TRUE(concurrentTrie.size() == left.size());
+        IS_TRUE(concurrentTrie.countWithPrefix("") == left.size());
+        IS_TRUE(concurrentTrie.countWithPrefix("pfx/") == left.size());
+
+        IS_TRUE(concurrentTrie.removePrefix("pfx/") == left.size());
+        IS_TRUE(concurrentTrie.size() == 0);
+        concurrentTrie.insert(&left);
+    }
+
+    ConcurrentTrie recovered;
+    recovered.enableDurability(directory, 0);
+    IS_TRUE(recovered.getAllStringsSorted() == left);
+    IS_TRUE(recovered.size() == left.size());
+
+    removeDirectory(directory);
+}
+
+// Intersects a trie with another while other threads insert into it, so that whole subtrees are dropped while
+// inserts are inside them. The counts must match the strings that are left.
+void testIntersectWithConcurrentInserts(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    ConcurrentTrie other;
+    for (int i = 0; i < wordList.size(); i += 2) {
+        other.insert(wordList[i]);
+    }
 
+    #pragma omp parallel num_threads(4)
+    {
+        int t = omp_get_thread_num();
+        if (t == 0) {
+            for (int round = 0; round < 200; round++) {
+                concurrentTrie.intersect(other);
+            }
+        } else {
+            for (int round = 0; round < 10; round++) {
+                for (int i = t - 1; i < wordList.size(); i += 3) {
+                    concurrentTrie.insert(wordList[i] + std::to_string(round));  // Mostly dropped by the next intersect
+                }
+            }
+        }
+    }
+
+    std::vector<std::string> left = concurrentTrie.getAllStringsSorted();
+    IS_TRUE(concurrentTrie.size() == left.size());
+    IS_TRUE(concurrentTrie.countWithPrefix("") == left.size());
+    concurrentTrie.intersect(other);
+    for (std::string word : concurrentTrie.getAllStringsSorted()) {
+        IS_TRUE(other.contains(word));
+    }
+    IS_TRUE(concurrentTrie.size() == concurrentTrie.getAllStringsSorted().size());
 }
 
+// Runs bulk writes, bulk lookups and single-word readers and writers against each other. A bulk operation takes the
+// trie's locks once, so a reader or writer queued in the meantime cannot leave it waiting on itself.
+void testBulkOperationsWithReaders(std::vector<std::string> wordList) {
 
-std::vector<std::string> loadWords(std::string filepath, int numWords) {
-    std::vector<std::string> wordList;
-    std::string word;
+    ConcurrentTrie concurrentTrie;
+    std::set<std::string> unique(wordList.begin(), wordList.end());  // So that no word is both in bulk and in single
+    std::vector<std::string> words(unique.begin(), unique.end());
+    std::vector<std::string> bulk, single;
+    for (int i = 0; i < words.size() && i < 4000; i++) {
+        (i % 2 == 0 ? bulk : single).push_back(words[i]);
+    }
 
-    int wordNum = 0;
-    std::ifstream* wordListFile = new std::ifstream(filepath);
-    if (wordListFile->is_open()) {
-        while (std::getline(*wordListFile, word)) {
-            wordNum++;
-            // Check if word is valid
-            for (char c : word) {
-                if (int(c) < 0 || int(c) > 127) {
-                    printf("Word num %d is invalid\n", wordNum);
-                    break;
+    std::string packed;
+    std::vector<size_t> offsets = {0};
+    for (std::string word : bulk) {
+        packed += word;
+        offsets.push_back(packed.size());
+    }
+    std::vector<uint8_t> results(bulk.size());
+    std::vector<uint64_t> bits((bulk.size() + 63) / 64);
+
+    std::string directory = makeTempDirectory();
+    std::string filepath = directory + "/bulk.txt";
+    {
+        std::ofstream file(filepath, std::ios::binary);
+        for (std::string word : bulk) {
+            file << word << "\n";
+        }
+    }
+
+    #pragma omp parallel num_threads(4)
+    {
+        int t = omp_get_thread_num();
+        for (int round = 0; round < 20; round++) {
+            if (t == 0) {
+                concurrentTrie.insert(&bulk);
+                concurrentTrie.remove(&bulk);
+                concurrentTrie.insertFromFile(filepath);
+                concurrentTrie.remove(&bulk);
+                concurrentTrie.insert(packed, offsets);
+                concurrentTrie.remove(packed, offsets);
+            } else if (t == 1) {
+                concurrentTrie.contains(&bulk);
+                concurrentTrie.contains(packed, offsets, results);
+                concurrentTrie.contains(packed, offsets, bits);
+            } else {
+                for (int i = t - 2; i < single.size(); i += 2) {
+                    concurrentTrie.insert(single[i]);
+                    concurrentTrie.contains(single[i]);
                 }
             }
-            wordList.push_back(word);
-            if (wordNum == numWords) break;
         }
     }
-    return wordList;
+
+    IS_TRUE(concurrentTrie.size() == single.size());
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == single);
+
+    removeDirectory(directory);
 }
+
+// Logs the word list from several threads at once, with checkpoints taken along the way, and recovers it.
+// Checkpoints are taken on a thread of the trie's own, so writers holding the locks never wait for one.
+void testDurabilityWithConcurrentWriters(std::vector<std::string> wordList) {
+
+    std::string directory = makeTempDirectory();
+    int half = wordList.size() / 2;
+
+    {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.enableDurability(directory, 300);
+        concurrentTrie.insert(&wordList);
+
+        // Bulk writes of kept words alongside single removes, while checkpoints are being taken
+        std::unordered_set<std::string> removed(wordList.begin(), wordList.begin() + half);
+        std::vector<std::string> bulk;
+        for (int i = half; i < wordList.size() && bulk.size() < 2000; i++) {
+            if (removed.count(wordList[i]) == 0) {
+                bulk.push_back(wordList[i]);
+            }
+        }
+        #pragma omp parallel num_threads(4)
+        {
+            int t = omp_get_thread_num();
+            if (t == 0) {
+                for (int round = 0; round < 10; round++) {
+                    concurrentTrie.remove(&bulk);
+                    concurrentTrie.insert(&bulk);
+                }
+            } else {
+                for (int i = t - 1; i < half; i += 3) {
+                    concurrentTrie.remove(wordList[i]);
+                }
+            }
+        }
+    }
+
+    SequentialTrie sequentialTrie;
+    for (int i = 0; i < wordList.size(); i++) {
+        sequentialTrie.insert(wordList[i]);
+    }
+    for (int i = 0; i < half; i++) {
+        sequentialTrie.remove(wordList[i]);
+    }
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.enableDurability(directory, 300);
+    IS_TRUE(concurrentTrie.getAllStringsSorted() == sequentialTrie.getAllStringsSorted());
+    IS_TRUE(concurrentTrie.size() == sequentialTrie.getAllStringsSorted().size());
+
+    removeDirectory(directory);
+}
+
+void testShardedTrieOnWordList(std::vector<std::string> wordList) {
+
+    ShardedTrie shardedTrie;  // One shard per NUMA node
+    ShardedTrie manyShards(5);
+    ConcurrentTrie concurrentTrie;
+    shardedTrie.insert(&wordList);
+    manyShards.insert(&wordList);
+    concurrentTrie.insert(&wordList);
+
+    IS_TRUE(shardedTrie.getAllStringsSorted() == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(manyShards.getAllStringsSorted() == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(manyShards.size() == concurrentTrie.size());
+    IS_TRUE(manyShards.getStringsWithPrefix("ca") == concurrentTrie.getStringsWithPrefix("ca"));
+
+    std::vector<std::string> half(wordList.begin(), wordList.begin() + wordList.size() / 2);
+    manyShards.remove(&half);
+    concurrentTrie.remove(&half);
+    IS_TRUE(manyShards.getAllStringsSorted() == concurrentTrie.getAllStringsSorted());
+    IS_TRUE(manyShards.contains(&wordList) == concurrentTrie.contains(&wordList));
+}
+
+// The filter must never make contains() miss a string, whatever order concurrent inserts and removes run in
+void testFilterOnWordList(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.enableFilter(wordList.size() * 10, 0.01);
+    std::unordered_set<std::string> present;
+
+    int half = wordList.size() / 2;
+    std::vector<std::string> firstHalf(wordList.begin(), wordList.begin() + half);
+    std::vector<std::string> secondHalf(wordList.begin() + half, wordList.end());
+    concurrentTrie.insert(&firstHalf);
+    concurrentTrie.insert(&secondHalf);
+    std::vector<std::string> toRemove(wordList.begin(), wordList.begin() + half / 2);
+    concurrentTrie.remove(&toRemove);
+
+    present.insert(wordList.begin(), wordList.end());
+    for (std::string word : toRemove) {
+        present.erase(word);
+    }
+
+    std::vector<bool> results = concurrentTrie.contains(&wordList);
+    for (int i = 0; i < wordList.size(); i++) {
+        IS_TRUE(results[i] == (present.count(wordList[i]) == 1));
+    }
+    IS_TRUE(concurrentTrie.filterStats().falsePositiveRate < 0.01);
+}
+
+
+void testJumpTableOnWordList(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.enableJumpTable();
+    std::unordered_set<std::string> present(wordList.begin(), wordList.end());
+
+    concurrentTrie.insert(&wordList);
+    std::vector<bool> results = concurrentTrie.contains(&wordList);
+    for (int i = 0; i < wordList.size(); i++) {
+        IS_TRUE(results[i]);
+    }
+
+    // Removing every word of some first characters frees first-level and second-level nodes the table has used
+    std::vector<std::string> toRemove;
+    for (std::string word : wordList) {
+        if (!word.empty() && word[0] % 3 == 0) {
+            toRemove.push_back(word);
+            present.erase(word);
+        }
+    }
+    concurrentTrie.remove(&toRemove);
+
+    results = concurrentTrie.contains(&wordList);
+    for (int i = 0; i < wordList.size(); i++) {
+        IS_TRUE(results[i] == (present.count(wordList[i]) == 1));
+    }
+    IS_TRUE(concurrentTrie.size() == present.size());
+}
+
+void testSkewedBulkOperations(std::vector<std::string> wordList) {
+
+    // Chunks of about the same cost, however the costs are spread
+    std::vector<int> costs = {1, 1, 1, 1, 100, 1, 1, 50, 50, 1};
+    std::vector<int> chunks = chunkByCost(costs.size(), [&costs](int i) { return (long long) costs[i]; }, 50, 4);
+    IS_TRUE(chunks == std::vector<int>({0, 5, 8, 9, 10}));
+    chunks = chunkByCost(0, [](int i) { return 1LL; }, 0, 4);
+    IS_TRUE(chunks == std::vector<int>({0}));
+
+    // A few long keys, all at the start of the batch
+    std::vector<std::string> words;
+    for (int i = 0; i < wordList.size(); i++) {
+        std::string word = wordList[i];
+        if (i < wordList.size() / 100) {
+            while (word.length() < 200) {
+                word += wordList[i];
+            }
+        }
+        words.push_back(word);
+    }
+    std::vector<std::string> expected(words.begin(), words.end());
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+    long long grainSizes[] = {0, 1, 4096, 1LL << 40};
+    for (long long grainSize : grainSizes) {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.insert(&words, grainSize);
+        std::vector<bool> results = concurrentTrie.contains(&words, grainSize);
+        for (int i = 0; i < words.size(); i++) {
+            IS_TRUE(results[i]);
+        }
+        IS_TRUE(concurrentTrie.getAllStringsSorted() == expected);  // Listed in parallel, in pieces
+
+        concurrentTrie.remove(&words, grainSize);
+        IS_TRUE(concurrentTrie.size() == 0);
+    }
+}
+
+void testPackedBatchesOnWordList(std::vector<std::string> wordList) {
+
+    std::string data;
+    std::vector<size_t> offsets(1, 0);
+    for (int i = 0; i < wordList.size(); i++) {
+        data += wordList[i];
+        offsets.push_back(data.size());
+    }
+    std::vector<std::string> expected(wordList.begin(), wordList.end());
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+    long long grainSizes[] = {0, 1, 4096};
+    for (long long grainSize : grainSizes) {
+        ConcurrentTrie concurrentTrie;
+        concurrentTrie.setNumThreads(4);
+        concurrentTrie.insert(data, offsets, grainSize);
+        IS_TRUE(concurrentTrie.getAllStringsSorted() == expected);
+
+        // The first half is removed, and removing it again changes nothing
+        std::vector<size_t> firstHalf(offsets.begin(), offsets.begin() + wordList.size() / 2 + 1);
+        concurrentTrie.remove(data, firstHalf, grainSize);
+        concurrentTrie.remove(data, firstHalf, grainSize);
+        std::vector<bool> expectedResults = concurrentTrie.contains(&wordList);
+
+        std::vector<uint8_t> results(wordList.size());
+        concurrentTrie.contains(data, offsets, results, grainSize);
+        std::vector<uint64_t> bits((wordList.size() + 63) / 64);
+        concurrentTrie.contains(data, offsets, bits, grainSize);
+        for (int i = 0; i < wordList.size(); i++) {
+            IS_TRUE(results[i] == expectedResults[i]);
+            IS_TRUE(((bits[i / 64] >> (i % 64)) & 1) == expectedResults[i]);
+            if (i < wordList.size() / 2) {
+                IS_TRUE(!results[i]);
+            }
+        }
+    }
+}
+
+void testFrontCodedOnWordList(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert(&wordList);
+
+    std::vector<std::string> sorted = concurrentTrie.getAllStringsSorted();
+    FrontCodedBlock block = concurrentTrie.getStringsWithPrefixFrontCoded("");
+    IS_TRUE(block.size() == sorted.size());
+    IS_TRUE(block.toVector() == sorted);
+
+    size_t totalLength = 0;
+    for (int i = 0; i < sorted.size(); i++) {
+        totalLength += sorted[i].length();
+    }
+    IS_TRUE(block.bytes().size() < totalLength);  // Sorted words share most of their prefixes
+}
+
+void testMinimizeOnWordList(std::vector<std::string> wordList) {
+
+    ConcurrentTrie concurrentTrie;
+    concurrentTrie.insert(&wordList);
+    std::shared_ptr<Dawg> dawg = concurrentTrie.minimize();
+
+    std::vector<std::string> sorted = concurrentTrie.getAllStringsSorted();
+    IS_TRUE(dawg->size() == sorted.size());
+    IS_TRUE(dawg->getAllStringsSorted() == sorted);
+    for (int i = 0; i < sorted.size(); i += 97) {
+        IS_TRUE(dawg->contains(sorted[i]));
+        IS_TRUE(dawg->ordinal(sorted[i]) == i);
+        IS_TRUE(dawg->keyAt(i) == sorted[i]);
+    }
+
+    // Fewer states than a trie has nodes - a trie has at least one node per distinct last character of each string
+    IS_TRUE(dawg->numStates() < sorted.size());
+}
+
+// Keeps a replica in step with the trie through the change stream while another thread inserts and removes words
+void testChangeStreamWithConcurrentWriter(std::vector<std::string> wordList) {
+
+    std::shared_ptr<ConcurrentTrie> concurrentTrie = std::make_shared<ConcurrentTrie>();
+    concurrentTrie->enableChangeStream(1 << 20);
+    std::vector<std::string> firstHalf(wordList.begin(), wordList.begin() + wordList.size() / 2);
+    concurrentTrie->insert(&firstHalf);
+
+    std::shared_ptr<TrieSnapshot> snapshot = concurrentTrie->snapshot();
+    std::vector<std::string> strings = snapshot->getAllStringsSorted();
+    std::set<std::string> replica(strings.begin(), strings.end());
+    long long version = snapshot->version();
+
+    std::thread writer([concurrentTrie, &wordList]() {
+        for (int i = 0; i < wordList.size(); i++) {
+            if (i % 3 == 0) {
+                concurrentTrie->remove(wordList[i]);
+            } else {
+                concurrentTrie->insert(wordList[i]);
+            }
+        }
+    });
+    for (int i = 0; i < 20; i++) {
+        ChangeSet changeSet = concurrentTrie->changesSince(version);
+        IS_FALSE(changeSet.resyncNeeded);
+        applyChanges(changeSet, replica);
+        version = changeSet.version;
+    }
+    writer.join();
+
+    applyChanges(concurrentTrie->changesSince(version), replica);
+    std::vector<std::string> expected = concurrentTrie->getAllStringsSorted();
+    IS_TRUE(std::vector<std::string>(replica.begin(), replica.end()) == expected);
+}
+
+void concurrentTests(std::vector<std::string> wordList) {
+
+    testMultipleInsert(wordList);
+    testMultipleContains(wordList);
+    testMultipleRemove(wordList);
+
+    testAsyncInsert(wordList);
+    testAsyncRemove(wordList);
+
+    testSetOperationsOnWordList(wordList);
+    testPagination(wordList);
+    testSnapshotWithConcurrentWriter(wordList);
+    testFuzzySearchMatchesBruteForce(wordList);
+    testScannerMatchesBruteForce(wordList);
+    testDurabilityWithConcurrentWriters(wordList);
+    testPruneWithConcurrentInserts(wordList);
+    testRemovePrefixWithConcurrentInserts(wordList);
+    testIntersectWithConcurrentInserts(wordList);
+    testBulkOperationsWithReaders(wordList);
+    testShardedTrieOnWordList(wordList);
+    testFilterOnWordList(wordList);
+    testJumpTableOnWordList(wordList);
+    testSkewedBulkOperations(wordList);
+    testPackedBatchesOnWordList(wordList);
+    testFrontCodedOnWordList(wordList);
+    testMinimizeOnWordList(wordList);
+    testChangeStreamWithConcurrentWriter(wordList);
+
+}
+
  
 // Driver
 int main(int argc, char const* argv[]) {
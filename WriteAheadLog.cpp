@@ -0,0 +1,381 @@
+#include "WriteAheadLog.h"
+
+#include <algorithm>  // std::sort
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>  // std::runtime_error
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "TRIECKP1"
+
+// Each record is laid out as: LSN (8 bytes), op (1 byte), key length (4 bytes), key, checksum (4 bytes).
+// The checksum covers everything before it, so a record torn by a crash is detected on recovery.
+#define RECORD_HEADER_SIZE 13
+#define CHECKSUM_SIZE 4
+
+
+static uint32_t checksum(const char* data, size_t length) {
+    // 32-bit FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void putFixed(std::string& out, uint64_t value, int numBytes) {
+    for (int i = 0; i < numBytes; i++) {
+        out.push_back(char((value >> (8 * i)) & 0xff));
+    }
+}
+
+static uint64_t getFixed(const char* data, int numBytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < numBytes; i++) {
+        value |= uint64_t((unsigned char) data[i]) << (8 * i);
+    }
+    return value;
+}
+
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+// Returns false if the varint runs past end.
+static bool getVarint(const char** data, const char* end, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; *data < end && shift < 64; shift += 7) {
+        unsigned char byte = **data;
+        (*data)++;
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readFile(const std::string& path, std::string* contents) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        contents->append(chunk, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+// Makes the entries of directory durable, so that files created or renamed in it survive a crash.
+static void syncDirectory(const std::string& directory) {
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open log directory " + directory);
+    }
+    int result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Cannot sync log directory " + directory);
+    }
+}
+
+static std::string segmentPath(const std::string& directory, long long firstLsn) {
+    char name[32];
+    snprintf(name, sizeof(name), "log.%020lld", firstLsn);
+    return directory + "/" + name;
+}
+
+
+WriteAheadLog::WriteAheadLog(std::string directory, long long lastLsn) {
+    directory_ = directory;
+    fd_ = -1;
+    lastLsn_ = lastLsn;
+    durableLsn_ = lastLsn;
+    flushing_ = false;
+    failed_ = false;
+    recordsSinceCheckpoint_ = 0;
+    mkdir(directory_.c_str(), 0755);  // May already exist
+    openSegment(lastLsn + 1);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        commit(lastLsn_);
+    } catch (const std::runtime_error&) {
+        // The records were not committed, so no caller was told they are durable
+    }
+    close(fd_);
+}
+
+void WriteAheadLog::openSegment(long long firstLsn) {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    std::string path = segmentPath(directory_, firstLsn);
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open log segment " + path);
+    }
+    segmentStart_ = firstLsn;
+    syncDirectory(directory_);
+}
+
+void WriteAheadLog::writeAll(int fd, const std::string& bytes) {
+    size_t written = 0;
+    while (written < bytes.length()) {
+        ssize_t n = write(fd, bytes.data() + written, bytes.length() - written);
+        if (n < 0) {
+            throw std::runtime_error("Cannot write to log");
+        }
+        written += n;
+    }
+}
+
+long long WriteAheadLog::append(char op, const char* key, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    long long lsn = ++lastLsn_;
+    size_t start = buffer_.length();
+    putFixed(buffer_, lsn, 8);
+    buffer_.push_back(op);
+    putFixed(buffer_, length, 4);
+    buffer_.append(key, length);
+    putFixed(buffer_, checksum(buffer_.data() + start, buffer_.length() - start), CHECKSUM_SIZE);
+    recordsSinceCheckpoint_++;
+    return lsn;
+}
+
+void WriteAheadLog::commit(long long lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (durableLsn_ < lsn) {
+        if (failed_) {
+            throw std::runtime_error("Log failed, so the record cannot be made durable");
+        }
+        if (flushing_) {
+            flushed_.wait(lock);  // Another writer's flush may well cover lsn too
+            continue;
+        }
+
+        // Become the flusher for everything buffered so far, including other writers' records
+        flushing_ = true;
+        std::string batch;
+        batch.swap(buffer_);
+        long long batchLsn = lastLsn_;
+        lock.unlock();
+
+        bool synced = false;
+        try {
+            writeAll(fd_, batch);
+            synced = fdatasync(fd_) == 0;
+        } catch (const std::runtime_error&) {
+            // Reported below, once the waiting writers have been woken
+        }
+
+        lock.lock();
+        if (synced) {
+            durableLsn_ = batchLsn;
+        } else {
+            failed_ = true;  // durableLsn_ stays where it was
+        }
+        flushing_ = false;
+        flushed_.notify_all();  // Woken writers either find their records durable or the log failed
+    }
+}
+
+long long WriteAheadLog::rotate() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (flushing_) {
+        flushed_.wait(lock);
+    }
+    if (failed_) {
+        throw std::runtime_error("Log failed, so it cannot be rotated");
+    }
+    try {
+        writeAll(fd_, buffer_);
+        if (fdatasync(fd_) != 0) {
+            throw std::runtime_error("Cannot sync log");
+        }
+    } catch (const std::runtime_error&) {
+        failed_ = true;
+        throw;
+    }
+    buffer_.clear();
+    durableLsn_ = lastLsn_;
+    openSegment(lastLsn_ + 1);
+    recordsSinceCheckpoint_ = 0;
+    return lastLsn_;
+}
+
+void WriteAheadLog::writeCheckpoint(const std::vector<std::string>& sortedKeys, long long lsn) {
+
+    // Front-code the keys: each one is stored as the length it shares with the previous key, then the rest of it
+    std::string contents = CHECKPOINT_MAGIC;
+    putFixed(contents, lsn, 8);
+    putFixed(contents, sortedKeys.size(), 8);
+    for (size_t i = 0; i < sortedKeys.size(); i++) {
+        size_t shared = 0;
+        if (i > 0) {
+            const std::string& prev = sortedKeys[i - 1];
+            while (shared < prev.length() && shared < sortedKeys[i].length() && prev[shared] == sortedKeys[i][shared]) {
+                shared++;
+            }
+        }
+        putVarint(contents, shared);
+        putVarint(contents, sortedKeys[i].length() - shared);
+        contents.append(sortedKeys[i], shared, std::string::npos);
+    }
+    putFixed(contents, checksum(contents.data(), contents.length()), CHECKSUM_SIZE);
+
+    // Write to a temporary file and rename it over the old checkpoint, so there is always one complete checkpoint
+    std::string path = directory_ + "/checkpoint";
+    std::string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot write checkpoint " + tempPath);
+    }
+    try {
+        writeAll(fd, contents);
+    } catch (const std::runtime_error&) {
+        close(fd);
+        throw;
+    }
+    int synced = fsync(fd);
+    close(fd);
+    if (synced != 0) {
+        throw std::runtime_error("Cannot sync checkpoint " + tempPath);  // The old checkpoint is still in place
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace checkpoint " + path);
+    }
+    syncDirectory(directory_);
+
+    // Every record in the segments before the current one is now covered by the checkpoint
+    long long currentSegment;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        currentSegment = segmentStart_;
+    }
+    std::vector<std::pair<long long, std::string>> segments = listSegments(directory_);
+    for (int i = 0; i < segments.size(); i++) {
+        if (segments[i].first < currentSegment && segments[i].first <= lsn) {
+            unlink(segments[i].second.c_str());
+        }
+    }
+}
+
+long long WriteAheadLog::recordsSinceCheckpoint() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recordsSinceCheckpoint_;
+}
+
+// Returns (first LSN, path) of every log segment in directory, oldest first.
+std::vector<std::pair<long long, std::string>> WriteAheadLog::listSegments(const std::string& directory) {
+    std::vector<std::pair<long long, std::string>> segments;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return segments;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name.compare(0, 4, "log.") == 0 && name.length() > 4) {
+            segments.push_back(std::make_pair(atoll(name.c_str() + 4), directory + "/" + name));
+        }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// Passes every valid record in the segment with an LSN after afterLsn to apply.
+// Returns the length of the valid part of the segment, which is shorter than the file if it ends in a torn record.
+size_t WriteAheadLog::replaySegment(const std::string& path, long long afterLsn, long long* lastLsn,
+                                    const std::function<void(char, const std::string&)>& apply) {
+    std::string contents;
+    if (!readFile(path, &contents)) {
+        throw std::runtime_error("Cannot read log segment " + path);
+    }
+    const char* data = contents.data();
+    size_t pos = 0;
+    while (pos < contents.length()) {
+        if (contents.length() - pos < RECORD_HEADER_SIZE + CHECKSUM_SIZE) {
+            break;
+        }
+        long long lsn = getFixed(data + pos, 8);
+        char op = data[pos + 8];
+        size_t keyLength = getFixed(data + pos + 9, 4);
+        size_t recordLength = RECORD_HEADER_SIZE + keyLength;
+        if (contents.length() - pos < recordLength + CHECKSUM_SIZE) {
+            break;
+        }
+        if (checksum(data + pos, recordLength) != getFixed(data + pos + recordLength, CHECKSUM_SIZE)) {
+            break;
+        }
+        if (lsn > afterLsn) {
+            apply(op, std::string(data + pos + RECORD_HEADER_SIZE, keyLength));
+            *lastLsn = lsn;
+        }
+        pos += recordLength + CHECKSUM_SIZE;
+    }
+    return pos;
+}
+
+long long WriteAheadLog::recover(std::string directory, const std::function<void(const std::vector<std::string>&)>& load,
+                                 const std::function<void(char, const std::string&)>& apply) {
+
+    long long lastLsn = 0;
+
+    std::string contents;
+    if (readFile(directory + "/checkpoint", &contents)) {
+        size_t headerSize = 8 + 8 + 8;
+        if (contents.length() < headerSize + CHECKSUM_SIZE || contents.compare(0, 8, CHECKPOINT_MAGIC) != 0 ||
+            checksum(contents.data(), contents.length() - CHECKSUM_SIZE) != getFixed(contents.data() + contents.length() - CHECKSUM_SIZE, CHECKSUM_SIZE)) {
+            throw std::runtime_error("Corrupted checkpoint in " + directory);
+        }
+        lastLsn = getFixed(contents.data() + 8, 8);
+        uint64_t numKeys = getFixed(contents.data() + 16, 8);
+
+        std::vector<std::string> keys;
+        keys.reserve(numKeys);
+        const char* data = contents.data() + headerSize;
+        const char* end = contents.data() + contents.length() - CHECKSUM_SIZE;
+        std::string key;
+        for (uint64_t i = 0; i < numKeys; i++) {
+            uint64_t shared, suffixLength;
+            if (!getVarint(&data, end, &shared) || !getVarint(&data, end, &suffixLength) ||
+                shared > key.length() || suffixLength > (uint64_t) (end - data)) {
+                throw std::runtime_error("Corrupted checkpoint in " + directory);
+            }
+            key.resize(shared);
+            key.append(data, suffixLength);
+            data += suffixLength;
+            keys.push_back(key);
+        }
+        load(keys);
+    }
+
+    std::vector<std::pair<long long, std::string>> segments = listSegments(directory);
+    for (int i = 0; i < segments.size(); i++) {
+        size_t validLength = replaySegment(segments[i].second, lastLsn, &lastLsn, apply);
+
+        // A torn record at the end of a segment was never committed - cut it off,
+        // so that the records appended to the next segment after recovery are not hidden behind it
+        struct stat info;
+        if (stat(segments[i].second.c_str(), &info) == 0 && (size_t) info.st_size > validLength) {
+            if (truncate(segments[i].second.c_str(), validLength) != 0) {
+                throw std::runtime_error("Cannot truncate log segment " + segments[i].second);
+            }
+        }
+    }
+    return lastLsn;
+}
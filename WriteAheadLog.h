@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>  // std::function
+#include <mutex>
+#include <stddef.h>  // size_t
+#include <string>
+#include <vector>
+
+
+// An append-only log of the changes made to a ConcurrentTrie, together with checkpoints of its contents,
+// kept in one directory:
+//   checkpoint       - every string in the trie at some log sequence number (LSN), front-coded in sorted order
+//   log.<first LSN>  - log segments, each holding the records from its first LSN onwards
+// A new segment is started at every checkpoint, so segments older than the latest checkpoint can be deleted.
+//
+// Records are appended to an in-memory buffer and made durable by commit(). Writers that commit at the same
+// time share a single write and fsync (group commit): the first one flushes everything buffered so far,
+// and the others wait for it instead of issuing their own fsync.
+//
+// If a write or an fsync of the log fails, the records in flight may or may not have reached the disk, and the
+// kernel may have dropped the pages that failed, so retrying could report records durable that are not. The log
+// is marked failed instead, and every later commit() and rotate() throws std::runtime_error.
+class WriteAheadLog {
+
+    private:
+        std::string directory_;
+        int fd_;  // Current log segment
+        long long segmentStart_;  // First LSN of the current log segment
+
+        std::mutex mutex_;  // Protects the variables below
+        std::condition_variable flushed_;
+        std::string buffer_;  // Encoded records that have not been written yet
+        long long lastLsn_;  // LSN of the last appended record
+        long long durableLsn_;  // Every record up to this LSN has been fsynced
+        bool flushing_;  // Whether a writer is currently writing and fsyncing the buffer
+        bool failed_;  // Whether a write or fsync of the log has failed
+        long long recordsSinceCheckpoint_;
+
+        void openSegment(long long firstLsn);
+        void writeAll(int fd, const std::string& bytes);
+        static std::vector<std::pair<long long, std::string>> listSegments(const std::string& directory);
+        static size_t replaySegment(const std::string& path, long long afterLsn, long long* lastLsn,
+                                  const std::function<void(char, const std::string&)>& apply);
+
+    public:
+        // Record types
+        static const char OP_INSERT = 'I';
+        static const char OP_REMOVE = 'R';
+        static const char OP_REMOVE_PREFIX = 'P';
+
+        // Opens the log in directory, continuing after lastLsn (as returned by recover()).
+        WriteAheadLog(std::string directory, long long lastLsn);
+        ~WriteAheadLog();
+
+        // Reads the checkpoint and the log segments in directory. Every string in the checkpoint is passed to load
+        // in sorted order, and then every later record is passed to apply in log order. A segment is replayed up to
+        // its first incomplete or corrupted record, which was never committed. Returns the LSN of the last record recovered.
+        static long long recover(std::string directory, const std::function<void(const std::vector<std::string>&)>& load,
+                                 const std::function<void(char, const std::string&)>& apply);
+
+        // Buffers a record and returns its LSN. The record is not durable until commit() is called with its LSN.
+        long long append(char op, const char* key, size_t length);
+
+        // Waits until every record up to lsn is durable, flushing the buffer if no other writer is doing so.
+        // Throws std::runtime_error if the log has failed.
+        void commit(long long lsn);
+
+        // Makes every appended record durable and starts a new log segment. Returns the LSN of the last record
+        // in the old segments. Must be called while no records are being appended.
+        long long rotate();
+
+        // Atomically replaces the checkpoint with the given sorted strings as of lsn, then deletes the log
+        // segments that it makes unnecessary.
+        void writeCheckpoint(const std::vector<std::string>& sortedKeys, long long lsn);
+
+        long long recordsSinceCheckpoint();
+};
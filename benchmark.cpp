@@ -8,6 +8,8 @@
 
 #include "ConcurrentTrie.h"
 #include "SequentialTrie.h"
+#include "ShardedTrie.h"
+#include "utils/word_list.h"
 
 #define NUM_ITERATIONS 100000
 
@@ -25,30 +27,6 @@ double read_timer() {
 }
 
 
-std::vector<std::string> loadWords(std::string filepath, int numWords) {
-    std::vector<std::string> wordList;
-    std::string word;
-
-    int wordNum = 0;
-    std::ifstream* wordListFile = new std::ifstream(filepath);
-    if (wordListFile->is_open()) {
-        while (std::getline(*wordListFile, word)) {
-            wordNum++;
-            // Check if word is valid
-            for (char c : word) {
-                if (int(c) < 0 || int(c) > 127) {
-                    printf("Word num %d is invalid\n", wordNum);
-                    break;
-                }
-            }
-            wordList.push_back(word);
-            if (wordNum == numWords) break;
-        }
-    }
-    return wordList;
-}
-
-
 void time_initialisation() {
     double start_time, end_time;
 
@@ -472,6 +450,378 @@ void time_delete_multiple_words(std::vector<std::string> words) {
 
 }
 
+void time_load_words(std::string filepath, int numWords) {
+
+    double start_time, end_time;
+
+    printf("\n\n");
+
+    // Time reading the file line by line into a vector, then inserting the vector
+    start_time = read_timer();
+    std::vector<std::string> words;
+    std::string word;
+    std::ifstream wordListFile(filepath);
+    while (std::getline(wordListFile, word)) {
+        words.push_back(word);
+        if (words.size() == numWords) break;
+    }
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    conc_trie->insert(&words);
+    end_time = read_timer();
+    printf("[Conc getline] Time taken to load %ld strings: %g seconds.\n", words.size(), end_time - start_time);
+
+    // Time inserting straight from the memory-mapped file
+    start_time = read_timer();
+    std::shared_ptr<ConcurrentTrie> conc_trie_2 = std::make_shared<ConcurrentTrie>();
+    int numLoaded = conc_trie_2->insertFromFile(filepath, numWords);
+    end_time = read_timer();
+    printf("[Conc mmap] Time taken to load %d strings: %g seconds.\n", numLoaded, end_time - start_time);
+
+    if (conc_trie->size() != conc_trie_2->size()) {
+        printf("ERROR: getline != mmap!\n");
+    }
+
+    printf("\n\n");
+
+}
+
+void time_sharded_insert(std::vector<std::string> words) {
+
+    double start_time, end_time;
+    int numWords = words.size();
+
+    printf("\n\n");
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    start_time = read_timer();
+    conc_trie->insert(&words);
+    end_time = read_timer();
+    printf("[Conc] Time taken to add %d strings: %g seconds.\n", numWords, end_time - start_time);
+
+    // One shard per NUMA node
+    std::shared_ptr<ShardedTrie> sharded_trie = std::make_shared<ShardedTrie>();
+    start_time = read_timer();
+    sharded_trie->insert(&words);
+    end_time = read_timer();
+    printf("[Sharded (Shards=%d)] Time taken to add %d strings: %g seconds.\n", sharded_trie->numShards(), numWords, end_time - start_time);
+
+    start_time = read_timer();
+    std::vector<bool> found = sharded_trie->contains(&words);
+    end_time = read_timer();
+    printf("[Sharded (Shards=%d)] Time taken to search for %d strings: %g seconds.\n", sharded_trie->numShards(), numWords, end_time - start_time);
+
+    printf("\n\n");
+
+}
+
+void time_absent_lookups_with_filter(std::vector<std::string> words) {
+
+    double start_time, end_time;
+    int numWords = words.size();
+
+    std::vector<std::string> absent;
+    for (std::string word : words) absent.push_back(word + "#");
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    conc_trie->insert(&words);
+    std::shared_ptr<ConcurrentTrie> filtered_trie = std::make_shared<ConcurrentTrie>();
+    filtered_trie->enableFilter(numWords * 10, 0.01);
+    filtered_trie->insert(&words);
+
+    printf("\n\n");
+
+    start_time = read_timer();
+    for (std::string word : absent) conc_trie->contains(word);
+    end_time = read_timer();
+    printf("[Conc] Average time taken to search for an absent string: %g seconds.\n", (end_time - start_time) / numWords);
+
+    start_time = read_timer();
+    for (std::string word : absent) filtered_trie->contains(word);
+    end_time = read_timer();
+    FilterStats stats = filtered_trie->filterStats();
+    printf("[Conc Filter (%ld bytes, %d hashes, expected false positive rate %g)] Average time taken to search for an absent string: %g seconds.\n",
+           stats.memoryBytes, stats.numHashes, stats.falsePositiveRate, (end_time - start_time) / numWords);
+
+    printf("\n\n");
+
+}
+
+void time_lookups_with_jump_table(std::vector<std::string> words) {
+
+    double start_time, end_time;
+    int numWords = words.size();
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    conc_trie->insert(&words);
+    std::shared_ptr<ConcurrentTrie> jump_trie = std::make_shared<ConcurrentTrie>();
+    jump_trie->enableJumpTable();
+    jump_trie->insert(&words);
+
+    printf("\n\n");
+
+    start_time = read_timer();
+    for (std::string word : words) conc_trie->contains(word);
+    end_time = read_timer();
+    printf("[Conc] Average time taken to search for a string: %g seconds.\n", (end_time - start_time) / numWords);
+
+    start_time = read_timer();
+    for (std::string word : words) jump_trie->contains(word);
+    end_time = read_timer();
+    printf("[Conc Jump Table] Average time taken to search for a string: %g seconds.\n", (end_time - start_time) / numWords);
+
+    start_time = read_timer();
+    conc_trie->contains(&words);
+    end_time = read_timer();
+    printf("[Conc] Time taken to search for all strings in parallel: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    jump_trie->contains(&words);
+    end_time = read_timer();
+    printf("[Conc Jump Table] Time taken to search for all strings in parallel: %g seconds.\n", end_time - start_time);
+
+    printf("\n\n");
+
+}
+
+void time_teardown(std::vector<std::string> words) {
+
+    double start_time, end_time;
+
+    printf("\n\n");
+
+    SequentialTrie* seq_trie = new SequentialTrie();
+    seq_trie->insert(&words);
+    start_time = read_timer();
+    seq_trie->clear();
+    end_time = read_timer();
+    printf("[Seq] Time taken to clear the trie: %g seconds.\n", end_time - start_time);
+
+    seq_trie->insert(&words);
+    start_time = read_timer();
+    delete seq_trie;
+    end_time = read_timer();
+    printf("[Seq] Time taken to destroy the trie: %g seconds.\n", end_time - start_time);
+
+    ConcurrentTrie* conc_trie = new ConcurrentTrie();
+    conc_trie->insert(&words);
+    start_time = read_timer();
+    conc_trie->clear();
+    end_time = read_timer();
+    printf("[Conc] Time taken to clear the trie: %g seconds.\n", end_time - start_time);
+
+    conc_trie->insert(&words);
+    start_time = read_timer();
+    delete conc_trie;
+    end_time = read_timer();
+    printf("[Conc] Time taken to destroy the trie: %g seconds.\n", end_time - start_time);
+
+    printf("\n\n");
+
+}
+
+void time_skewed_bulk_operations(std::vector<std::string> words) {
+
+    double start_time, end_time;
+
+    // 0.1% of the keys are about 2 KB long, and they all come first - the worst case for equal-sized blocks of keys
+    for (int i = 0; i < words.size() / 1000; i++) {
+        std::string word = words[i];
+        while (words[i].length() < 2000) words[i] += word;
+    }
+
+    printf("\n\n");
+
+    long long grainSizes[] = {0, KEY_OVERHEAD, 1 << 16, 1LL << 40};
+    const char* names[] = {"automatic", "one key", "64 KB", "one chunk"};
+    for (int g = 0; g < 4; g++) {
+        std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+
+        start_time = read_timer();
+        conc_trie->insert(&words, grainSizes[g]);
+        end_time = read_timer();
+        printf("[Conc grain %s] Time taken to insert skewed-length words: %g seconds.\n", names[g], end_time - start_time);
+
+        start_time = read_timer();
+        conc_trie->contains(&words, grainSizes[g]);
+        end_time = read_timer();
+        printf("[Conc grain %s] Time taken to search for skewed-length words: %g seconds.\n", names[g], end_time - start_time);
+
+        start_time = read_timer();
+        conc_trie->getAllStringsSorted();
+        end_time = read_timer();
+        printf("[Conc] Time taken to get sorted skewed-length words: %g seconds.\n", end_time - start_time);
+    }
+
+    printf("\n\n");
+
+}
+
+void time_small_batches(std::vector<std::string> words) {
+
+    double start_time, end_time;
+    int batchSize = 10;
+    int numBatches = std::min((int) words.size() / batchSize, 10000);
+
+    std::vector<std::vector<std::string>> batches(numBatches);
+    for (int b = 0; b < numBatches; b++) {
+        batches[b].assign(words.begin() + b * batchSize, words.begin() + (b + 1) * batchSize);
+    }
+
+    printf("\n\n");
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    start_time = read_timer();
+    for (int b = 0; b < numBatches; b++) {
+        conc_trie->insert(&batches[b]);
+    }
+    end_time = read_timer();
+    printf("[Conc] Time taken to insert %d batches of %d words: %g seconds.\n", numBatches, batchSize, end_time - start_time);
+
+    start_time = read_timer();
+    for (int b = 0; b < numBatches; b++) {
+        conc_trie->contains(&batches[b]);
+    }
+    end_time = read_timer();
+    printf("[Conc] Time taken to search for %d batches of %d words: %g seconds.\n", numBatches, batchSize, end_time - start_time);
+
+    // The same words one at a time, which never starts a parallel region
+    std::shared_ptr<ConcurrentTrie> single_trie = std::make_shared<ConcurrentTrie>();
+    start_time = read_timer();
+    for (int b = 0; b < numBatches; b++) {
+        for (int i = 0; i < batchSize; i++) {
+            single_trie->insert(batches[b][i]);
+        }
+    }
+    end_time = read_timer();
+    printf("[Conc one at a time] Time taken to insert %d batches of %d words: %g seconds.\n", numBatches, batchSize, end_time - start_time);
+
+    start_time = read_timer();
+    for (int b = 0; b < numBatches; b++) {
+        for (int i = 0; i < batchSize; i++) {
+            single_trie->contains(batches[b][i]);
+        }
+    }
+    end_time = read_timer();
+    printf("[Conc one at a time] Time taken to search for %d batches of %d words: %g seconds.\n", numBatches, batchSize, end_time - start_time);
+
+    printf("\n\n");
+
+}
+
+void time_packed_batches(std::vector<std::string> words) {
+
+    double start_time, end_time;
+
+    // The words packed the way they arrive over RPC
+    std::string data;
+    std::vector<size_t> offsets(1, 0);
+    for (int i = 0; i < words.size(); i++) {
+        data += words[i];
+        offsets.push_back(data.size());
+    }
+    std::vector<uint8_t> results(words.size());
+    std::vector<uint64_t> bits((words.size() + 63) / 64);
+
+    printf("\n\n");
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    start_time = read_timer();
+    conc_trie->insert(data, offsets);
+    end_time = read_timer();
+    printf("[Conc packed] Time taken to insert multiple words: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    conc_trie->contains(data, offsets, results);
+    end_time = read_timer();
+    printf("[Conc packed] Time taken to search for multiple words into bytes: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    conc_trie->contains(data, offsets, bits);
+    end_time = read_timer();
+    printf("[Conc packed] Time taken to search for multiple words into bits: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    conc_trie->contains(&words);
+    end_time = read_timer();
+    printf("[Conc vector] Time taken to search for multiple words: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    conc_trie->remove(data, offsets);
+    end_time = read_timer();
+    printf("[Conc packed] Time taken to remove multiple words: %g seconds.\n", end_time - start_time);
+
+    printf("\n\n");
+
+}
+
+void time_front_coded_prefix_query(std::vector<std::string> words) {
+
+    double start_time, end_time;
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    conc_trie->insert(&words);
+
+    printf("\n\n");
+
+    start_time = read_timer();
+    std::vector<std::string> strings = conc_trie->getStringsWithPrefix("");
+    end_time = read_timer();
+    size_t vectorBytes = strings.capacity() * sizeof(std::string);
+    for (int i = 0; i < strings.size(); i++) {
+        if (strings[i].capacity() > 15) vectorBytes += strings[i].capacity() + 1;  // Past the small string buffer
+    }
+    printf("[Conc vector] Time taken to get all words: %g seconds, %zu bytes.\n", end_time - start_time, vectorBytes);
+
+    start_time = read_timer();
+    FrontCodedBlock block = conc_trie->getStringsWithPrefixFrontCoded("");
+    end_time = read_timer();
+    printf("[Conc front-coded] Time taken to get all words: %g seconds, %zu bytes.\n", end_time - start_time, block.bytes().size());
+
+    start_time = read_timer();
+    size_t totalLength = 0;
+    for (const std::string& string : block) {
+        totalLength += string.length();
+    }
+    end_time = read_timer();
+    printf("[Conc front-coded] Time taken to decode all words: %g seconds (%zu characters).\n", end_time - start_time, totalLength);
+
+    printf("\n\n");
+
+}
+
+void time_minimize(std::vector<std::string> words) {
+
+    double start_time, end_time;
+
+    std::shared_ptr<ConcurrentTrie> conc_trie = std::make_shared<ConcurrentTrie>();
+    conc_trie->insert(&words);
+
+    printf("\n\n");
+
+    start_time = read_timer();
+    std::shared_ptr<Dawg> dawg = conc_trie->minimize();
+    end_time = read_timer();
+    printf("[Dawg] Time taken to minimize: %g seconds, %d states and %d edges for %d words.\n",
+           end_time - start_time, dawg->numStates(), dawg->numEdges(), dawg->size());
+
+    start_time = read_timer();
+    for (int i = 0; i < words.size(); i++) {
+        dawg->contains(words[i]);
+    }
+    end_time = read_timer();
+    printf("[Dawg] Time taken to search for multiple words: %g seconds.\n", end_time - start_time);
+
+    start_time = read_timer();
+    for (int i = 0; i < words.size(); i++) {
+        conc_trie->contains(words[i]);
+    }
+    end_time = read_timer();
+    printf("[Conc] Time taken to search for multiple words: %g seconds.\n", end_time - start_time);
+
+    printf("\n\n");
+
+}
+
 
 int main(int argc, char const* argv[]) {
 
@@ -501,6 +851,16 @@ int main(int argc, char const* argv[]) {
     printf("7. Time removing multiple words\n");
     printf("8. Time getting sorted words\n");
     printf("9. Time getting sorted words with prefix\n");
+    printf("10. Time loading the word list from the file\n");
+    printf("11. Time adding multiple words to a sharded trie\n");
+    printf("12. Time searching for absent strings with a filter\n");
+    printf("13. Time searching for strings with a root jump table\n");
+    printf("14. Time clearing and destroying a full trie\n");
+    printf("15. Time bulk operations on skewed-length words with different grain sizes\n");
+    printf("16. Time bulk operations on small batches\n");
+    printf("17. Time bulk operations on packed words\n");
+    printf("18. Time prefix queries with front-coded results\n");
+    printf("19. Time minimizing into a DAWG\n");
 
     int choice;
     scanf("%d", &choice);
@@ -513,6 +873,16 @@ int main(int argc, char const* argv[]) {
     else if (choice == 7) time_delete_multiple_words(wordList);
     else if (choice == 8) time_get_sorted_words(wordList);
     else if (choice == 9) time_get_strings_with_prefix(wordList, prefix);
+    else if (choice == 10) time_load_words(filepath, maxNumWords);
+    else if (choice == 11) time_sharded_insert(wordList);
+    else if (choice == 12) time_absent_lookups_with_filter(wordList);
+    else if (choice == 13) time_lookups_with_jump_table(wordList);
+    else if (choice == 14) time_teardown(wordList);
+    else if (choice == 15) time_skewed_bulk_operations(wordList);
+    else if (choice == 16) time_small_batches(wordList);
+    else if (choice == 17) time_packed_batches(wordList);
+    else if (choice == 18) time_front_coded_prefix_query(wordList);
+    else if (choice == 19) time_minimize(wordList);
     else printf("Invalid choice.\n");
     
     return 0;
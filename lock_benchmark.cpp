@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <omp.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "utils/readers_writers.h"
+
+// Microbenchmarks for FairReadersWriters and Semaphore on their own, without a trie around them.
+// Every scenario is run for 1, 2, 4, ... threads up to the maximum given, and reports the throughput, and the
+// median, 99th percentile and maximum time taken to acquire the lock. The maximum is the fairness figure: how long
+// the unluckiest reader or writer was kept waiting.
+//
+// Usage: ./lock_benchmark [maxThreads = 8] [opsPerThread = 20000]
+
+#define CRITICAL_WORK 50  // Iterations of busy work while holding the lock
+#define OUTSIDE_WORK 50  // Iterations of busy work between two acquisitions
+#define BURST_PERIOD 1000  // In the bursty scenario, every thread writes for BURST_LENGTH operations out of every BURST_PERIOD
+#define BURST_LENGTH 50
+
+
+double read_timer() {
+  static bool initialized = false;
+  static struct timeval start;
+  struct timeval end;
+  if (!initialized) {
+      gettimeofday( &start, NULL );
+      initialized = true;
+  }
+  gettimeofday( &end, NULL );
+  return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+inline long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void busy_work(int iterations) {
+    volatile int sink = 0;
+    for (int i = 0; i < iterations; i++) {
+        sink = sink + i;
+    }
+}
+
+// Prints the throughput and acquisition latencies of one role (readers, writers) in one run
+void print_stats(const char* scenario, const char* role, int numThreads, double seconds, std::vector<std::vector<long long>>& perThread) {
+
+    std::vector<long long> latencies;
+    for (int t = 0; t < perThread.size(); t++) {
+        latencies.insert(latencies.end(), perThread[t].begin(), perThread[t].end());
+    }
+    if (latencies.empty()) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    long long p50 = latencies[latencies.size() / 2];
+    long long p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    long long max = latencies.back();
+    printf("[%s] %d threads, %s: %g ops/s, acquire p50 %lld ns, p99 %lld ns, max %lld ns.\n",
+           scenario, numThreads, role, latencies.size() / seconds, p50, p99, max);
+}
+
+// Runs numThreads threads against one FairReadersWriters. Each operation is a write with probability
+// writeFraction, or, if bursty, during BURST_LENGTH out of every BURST_PERIOD operations - the bursts of all
+// threads line up, so writers arrive all at once and then leave the lock to the readers for a while.
+void time_readers_writers(const char* scenario, int numThreads, int opsPerThread, double writeFraction, bool bursty) {
+
+    FairReadersWriters lock;
+    std::vector<std::vector<long long>> readLatencies(numThreads);
+    std::vector<std::vector<long long>> writeLatencies(numThreads);
+    double start_time, end_time;
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+        int t = omp_get_thread_num();
+        std::minstd_rand rng(t + 1);
+        std::uniform_real_distribution<double> coin(0, 1);
+        readLatencies[t].reserve(opsPerThread);
+        writeLatencies[t].reserve(opsPerThread);
+
+        #pragma omp barrier
+        #pragma omp single
+        start_time = read_timer();
+
+        for (int i = 0; i < opsPerThread; i++) {
+            bool write = bursty ? (i % BURST_PERIOD < BURST_LENGTH) : (coin(rng) < writeFraction);
+            long long before = now_ns();
+            if (write) {
+                lock.startWrite();
+                writeLatencies[t].push_back(now_ns() - before);
+                busy_work(CRITICAL_WORK);
+                lock.endWrite();
+            } else {
+                lock.startRead();
+                readLatencies[t].push_back(now_ns() - before);
+                busy_work(CRITICAL_WORK);
+                lock.endRead();
+            }
+            busy_work(OUTSIDE_WORK);
+        }
+    }
+    end_time = read_timer();
+
+    print_stats(scenario, "readers", numThreads, end_time - start_time, readLatencies);
+    print_stats(scenario, "writers", numThreads, end_time - start_time, writeLatencies);
+}
+
+// Runs numThreads threads against one Semaphore with the given number of permits, each thread taking a permit,
+// working, and giving it back. With one permit this is a mutex.
+void time_semaphore(const char* scenario, int numThreads, int opsPerThread, int permits) {
+
+    Semaphore semaphore(permits);
+    std::vector<std::vector<long long>> latencies(numThreads);
+    double start_time, end_time;
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+        int t = omp_get_thread_num();
+        latencies[t].reserve(opsPerThread);
+
+        #pragma omp barrier
+        #pragma omp single
+        start_time = read_timer();
+
+        for (int i = 0; i < opsPerThread; i++) {
+            long long before = now_ns();
+            semaphore.wait();
+            latencies[t].push_back(now_ns() - before);
+            busy_work(CRITICAL_WORK);
+            semaphore.signal();
+            busy_work(OUTSIDE_WORK);
+        }
+    }
+    end_time = read_timer();
+
+    print_stats(scenario, "waiters", numThreads, end_time - start_time, latencies);
+}
+
+
+int main(int argc, char const* argv[]) {
+
+    int maxThreads = 8;
+    if (argc > 1) maxThreads = atoi(argv[1]);
+
+    int opsPerThread = 20000;
+    if (argc > 2) opsPerThread = atoi(argv[2]);
+
+    printf("Up to %d threads, %d operations per thread, %d processors.\n", maxThreads, opsPerThread, omp_get_num_procs());
+
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        printf("\n");
+        time_readers_writers("RW readers only", numThreads, opsPerThread, 0, false);
+        time_readers_writers("RW writers only", numThreads, opsPerThread, 1, false);
+        time_readers_writers("RW 10% writes", numThreads, opsPerThread, 0.1, false);
+        time_readers_writers("RW 50% writes", numThreads, opsPerThread, 0.5, false);
+        time_readers_writers("RW bursty writes", numThreads, opsPerThread, 0, true);
+        time_semaphore("Semaphore 1 permit", numThreads, opsPerThread, 1);
+        time_semaphore("Semaphore half as many permits as threads", numThreads, opsPerThread, std::max(1, numThreads / 2));
+    }
+
+    return 0;
+}
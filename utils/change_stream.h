@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>  // std::max
+#include <mutex>
+#include <stddef.h>  // size_t
+#include <stdexcept>  // std::invalid_argument
+#include <string>
+#include <vector>
+
+
+enum ChangeOp {
+    CHANGE_INSERT,
+    CHANGE_REMOVE,
+    CHANGE_REMOVE_PREFIX,  // Every string that starts with the key was removed - all of them for an empty key
+};
+
+// One committed change. version is the version of the trie right after it.
+struct ChangeEvent {
+    long long version;
+    ChangeOp op;
+    std::string key;
+    long long lsn;  // Of the change's write-ahead log record, 0 if it has none
+};
+
+// The result of ChangeStream::since(). If resyncNeeded is true the changes asked for are no longer kept, and the
+// reader has to start again from a snapshot (see TrieSnapshot::version()). Otherwise changes holds every change
+// after the version asked for, in order. Either way, version is the one to ask for next.
+struct ChangeSet {
+    bool resyncNeeded;
+    long long version;
+    std::vector<ChangeEvent> changes;
+};
+
+// A version counter and a ring buffer of the last capacity changes, so that a reader that has applied every change
+// up to some version can catch up by reading only the changes after it. Each change takes the next version, and
+// overwrites the oldest one once the buffer is full. The slots are allocated up front and keep the memory of their
+// keys, so recording a change only copies its key.
+// Changes whose strings are not known individually (such as set operations) are recorded with reset(), which
+// moves the version on and forgets the changes before it, so every reader that is behind has to resync.
+// Every method may be called from any number of threads at once.
+class ChangeStream {
+
+    private:
+        std::vector<ChangeEvent> slots_;  // The change with version v is in slots_[v % capacity]
+        long long version_;  // Version of the latest change, 0 before the first one
+        long long firstKept_;  // Changes before this one were forgotten by reset()
+        std::mutex mutex_;
+
+    public:
+        inline ChangeStream(size_t capacity) {
+            if (capacity == 0) {
+                throw std::invalid_argument("Change stream capacity must be positive");
+            }
+            slots_.resize(capacity);
+            version_ = 0;
+            firstKept_ = 1;
+        }
+
+        // Records a change, with the LSN of its log record, and returns its version
+        inline long long record(ChangeOp op, const char* key, size_t length, long long lsn) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            version_++;
+            ChangeEvent& slot = slots_[version_ % slots_.size()];
+            slot.version = version_;
+            slot.op = op;
+            slot.key.assign(key, length);
+            slot.lsn = lsn;
+            return version_;
+        }
+
+        // Moves the version on without recording what changed
+        inline long long reset() {
+            std::lock_guard<std::mutex> guard(mutex_);
+            version_++;
+            firstKept_ = version_ + 1;
+            return version_;
+        }
+
+        inline long long version() {
+            std::lock_guard<std::mutex> guard(mutex_);
+            return version_;
+        }
+
+        // Returns the changes after version (see ChangeSet)
+        inline ChangeSet since(long long version) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            ChangeSet result;
+            result.version = version_;
+            long long oldest = std::max(firstKept_, version_ - (long long) slots_.size() + 1);
+            result.resyncNeeded = version < oldest - 1 || version > version_;
+            if (!result.resyncNeeded) {
+                result.changes.reserve(version_ - version);
+                for (long long v = version + 1; v <= version_; v++) {
+                    result.changes.push_back(slots_[v % slots_.size()]);
+                }
+            }
+            return result;
+        }
+
+        inline size_t capacity() const {
+            return slots_.size();
+        }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>  // std::max
+#include <string>
+#include <vector>
+
+
+// Cost-aware chunking for the parallel loops. Items of very different cost - keys of 3 bytes and of 2 KB,
+// subtrees of one string and of ten thousand - are grouped into runs of consecutive items of about the same
+// total cost. The loops hand the chunks out one at a time to whichever thread is free (schedule(dynamic, 1)),
+// so a thread that drew cheap chunks takes more of them instead of sitting idle while another one works
+// through the expensive ones.
+
+// Chunks per thread when the grain is picked automatically - enough for the dynamic schedule to even out the
+// threads, few enough that handing out chunks costs little next to the work in them.
+#define CHUNKS_PER_THREAD 8
+
+// Fixed cost of a key in a bulk operation however short it is (the locks, the allocation and the bookkeeping),
+// in bytes of key length - a key of n bytes costs KEY_OVERHEAD + n.
+#define KEY_OVERHEAD 64
+
+inline long long keyCost(const std::string& key) {
+    return KEY_OVERHEAD + key.length();
+}
+
+// Returns the boundaries of the chunks of items [0, numItems): chunk c is [bounds[c], bounds[c + 1]).
+// cost(i) is the cost of item i, and a chunk takes items until its cost reaches grain. A grain of 0 or less
+// is picked from the total cost, so that each of numThreads threads gets about CHUNKS_PER_THREAD chunks.
+template <typename Cost>
+inline std::vector<int> chunkByCost(int numItems, Cost cost, long long grain, int numThreads) {
+    if (grain <= 0) {
+        long long total = 0;
+        for (int i = 0; i < numItems; i++) {
+            total += cost(i);
+        }
+        grain = std::max(1LL, total / (std::max(1, numThreads) * CHUNKS_PER_THREAD));
+    }
+    std::vector<int> bounds(1, 0);
+    long long chunkCost = 0;
+    for (int i = 0; i < numItems; i++) {
+        chunkCost += cost(i);
+        if (chunkCost >= grain) {
+            bounds.push_back(i + 1);
+            chunkCost = 0;
+        }
+    }
+    if (bounds.back() != numItems) {
+        bounds.push_back(numItems);
+    }
+    return bounds;
+}
+
+// Like chunkByCost(), for numKeys keys packed into one buffer, where key i is the bytes [offsets[i], offsets[i + 1]).
+// The cost of the keys before key i is then known from offsets alone, so the start of chunk c - the first key at
+// which that cost reaches c * grain - is found by binary search instead of being stored, and nothing is allocated.
+inline size_t packedChunkStart(const size_t* offsets, size_t numKeys, long long grain, long long c) {
+    long long target = c * grain;
+    size_t lo = 0;
+    size_t hi = numKeys;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (KEY_OVERHEAD * (long long) mid + (long long) (offsets[mid] - offsets[0]) >= target) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
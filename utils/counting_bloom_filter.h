@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>  // std::max
+#include <atomic>
+#include <cmath>  // std::log, std::exp, std::pow, std::round
+#include <functional>  // std::hash
+#include <memory>  // std::unique_ptr
+#include <stddef.h>  // size_t
+#include <stdexcept>  // std::invalid_argument
+#include <stdint.h>
+#include <string_view>
+
+
+// Sizing and expected accuracy of a CountingBloomFilter.
+struct FilterStats {
+    size_t memoryBytes;  // Memory used by the counters
+    int numHashes;  // Counters touched per key
+    long long capacity;  // Number of keys up to which the target false positive rate holds
+    double targetFalsePositiveRate;
+    double falsePositiveRate;  // Expected false positive rate with the number of keys currently in it
+};
+
+// A Bloom filter with a small counter instead of a bit in each slot, so that keys can be removed as well
+// as added. mayContain() never returns false for a key that has been added and not removed, and only
+// returns true for other keys with a small probability, which is what lets a lookup skip the trie for
+// most absent keys. Every method may be called from any number of threads at once.
+// A counter that reaches its maximum stays there, since its true count is no longer known - this can only
+// cause false positives, never false negatives.
+class CountingBloomFilter {
+
+    private:
+        static const uint8_t MAX_COUNT = 255;
+
+        std::unique_ptr<std::atomic<uint8_t>[]> counters_;
+        size_t numCounters_;
+        int numHashes_;
+        long long capacity_;
+        double targetFalsePositiveRate_;
+
+        // Double hashing - the i-th counter of a key is (h1 + i * h2) mod numCounters_
+        inline void hash(const char* key, size_t length, uint64_t* h1, uint64_t* h2) const {
+            *h1 = std::hash<std::string_view>()(std::string_view(key, length));
+            uint64_t mixed = *h1 * 0x9e3779b97f4a7c15ull;
+            *h2 = (mixed ^ (mixed >> 29)) | 1;  // Never 0, which would put every counter in the same place
+        }
+
+    public:
+        // Uses memoryBytes one-byte counters, with the number of hash functions that is best for the target
+        // false positive rate. The rate holds for up to capacity keys (see stats()).
+        inline CountingBloomFilter(size_t memoryBytes, double falsePositiveRate) {
+            if (memoryBytes == 0 || falsePositiveRate <= 0 || falsePositiveRate >= 1) {
+                throw std::invalid_argument("Invalid filter size or false positive rate");
+            }
+            numCounters_ = memoryBytes;
+            counters_.reset(new std::atomic<uint8_t>[numCounters_]);
+            for (size_t i = 0; i < numCounters_; i++) {
+                counters_[i].store(0, std::memory_order_relaxed);
+            }
+            targetFalsePositiveRate_ = falsePositiveRate;
+            numHashes_ = std::max(1, (int) std::round(-std::log2(falsePositiveRate)));
+            capacity_ = (long long) (numCounters_ * std::log(2.0) / numHashes_);
+        }
+
+        inline void add(const char* key, size_t length) {
+            uint64_t h1, h2;
+            hash(key, length, &h1, &h2);
+            for (int i = 0; i < numHashes_; i++) {
+                std::atomic<uint8_t>& counter = counters_[(h1 + i * h2) % numCounters_];
+                uint8_t count = counter.load(std::memory_order_relaxed);
+                while (count != MAX_COUNT && !counter.compare_exchange_weak(count, count + 1, std::memory_order_release)) {
+                }
+            }
+        }
+
+        // Must only be called for a key that was added and has not been removed since.
+        inline void remove(const char* key, size_t length) {
+            uint64_t h1, h2;
+            hash(key, length, &h1, &h2);
+            for (int i = 0; i < numHashes_; i++) {
+                std::atomic<uint8_t>& counter = counters_[(h1 + i * h2) % numCounters_];
+                uint8_t count = counter.load(std::memory_order_relaxed);
+                while (count != MAX_COUNT && count != 0 && !counter.compare_exchange_weak(count, count - 1, std::memory_order_release)) {
+                }
+            }
+        }
+
+        // Returns false if the key is certainly not in the filter.
+        inline bool mayContain(const char* key, size_t length) const {
+            uint64_t h1, h2;
+            hash(key, length, &h1, &h2);
+            for (int i = 0; i < numHashes_; i++) {
+                if (counters_[(h1 + i * h2) % numCounters_].load(std::memory_order_acquire) == 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline FilterStats stats(long long numKeys) const {
+            FilterStats stats;
+            stats.memoryBytes = numCounters_ * sizeof(std::atomic<uint8_t>);
+            stats.numHashes = numHashes_;
+            stats.capacity = capacity_;
+            stats.targetFalsePositiveRate = targetFalsePositiveRate_;
+            stats.falsePositiveRate = std::pow(1 - std::exp(-(double) numHashes_ * numKeys / numCounters_), numHashes_);
+            return stats;
+        }
+};
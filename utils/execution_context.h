@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>  // std::min, std::max
+#include <atomic>
+#include <mutex>
+#include <omp.h>
+
+
+// The thread budget of one trie, and the cost model that decides how much of it each bulk call uses.
+//
+// Every parallel loop asks for its threads through the num_threads clause instead of omp_set_num_threads(), so
+// tries with different budgets in one process do not override each other, and the OpenMP setting of the caller
+// is left alone. The threads themselves come from OpenMP's own pool, which keeps them between parallel regions.
+//
+// A parallel region costs a fixed amount to start and join, measured once per thread count. A call runs in
+// parallel only if each thread would get at least MIN_WORK_PER_REGION times that much work, and uses as many
+// threads as that allows, up to the budget. The time per unit of work (see utils/cost_chunks.h for the units)
+// is learned from the calls themselves, as a moving average, starting from DEFAULT_NS_PER_COST.
+class ExecutionContext {
+
+    private:
+        static constexpr double DEFAULT_NS_PER_COST = 10;
+        static constexpr double MIN_WORK_PER_REGION = 4;
+        static constexpr double LEARNING_RATE = 0.25;
+
+        std::atomic<int> maxThreads_;
+        std::atomic<double> nsPerCost_;
+
+        static constexpr int MAX_MEASURED_THREADS = 256;  // Larger thread counts use the measurement for this many
+
+        // Returns the time to start and join an empty parallel region of numThreads threads, in nanoseconds.
+        // Each thread count is measured by the first call that needs it; after that, calls only read an atomic.
+        static inline double regionOverheadNs(int numThreads) {
+            static std::atomic<double> measured[MAX_MEASURED_THREADS + 1];  // 0 until measured
+            static std::mutex measuring;
+            int slot = std::min(numThreads, MAX_MEASURED_THREADS);
+            double overhead = measured[slot].load(std::memory_order_acquire);
+            if (overhead > 0) {
+                return overhead;
+            }
+            std::lock_guard<std::mutex> lock(measuring);
+            overhead = measured[slot].load(std::memory_order_relaxed);
+            if (overhead == 0) {
+                overhead = 1e18;
+                for (int i = 0; i < 20; i++) {  // The first few also bring the threads up
+                    double start = omp_get_wtime();
+                    #pragma omp parallel num_threads(slot)
+                    {
+                    }
+                    overhead = std::min(overhead, (omp_get_wtime() - start) * 1e9);
+                }
+                overhead = std::max(overhead, 1.0);  // Never 0, which means unmeasured
+                measured[slot].store(overhead, std::memory_order_release);
+            }
+            return overhead;
+        }
+
+    public:
+        inline ExecutionContext(int maxThreads) {
+            maxThreads_ = std::max(1, maxThreads);
+            nsPerCost_ = DEFAULT_NS_PER_COST;
+        }
+
+        inline int maxThreads() {
+            return maxThreads_;
+        }
+
+        inline void setMaxThreads(int maxThreads) {
+            maxThreads_ = std::max(1, maxThreads);
+        }
+
+        // Returns the number of threads to use for totalCost units of work - 1 to run it sequentially.
+        inline int threadsFor(long long totalCost) {
+            int budget = maxThreads_;
+            if (budget == 1) {
+                return 1;
+            }
+            double workNs = totalCost * nsPerCost_.load(std::memory_order_relaxed);
+            double minWorkPerThread = MIN_WORK_PER_REGION * regionOverheadNs(budget);
+            return std::max(1, std::min(budget, (int) (workNs / minWorkPerThread)));
+        }
+
+        // Records that totalCost units of work took seconds on numThreads threads.
+        inline void record(long long totalCost, int numThreads, double seconds) {
+            if (totalCost <= 0) {
+                return;
+            }
+            double observed = seconds * 1e9 * numThreads / totalCost;
+            double estimate = nsPerCost_.load(std::memory_order_relaxed);
+            nsPerCost_.store(estimate + LEARNING_RATE * (observed - estimate), std::memory_order_relaxed);
+        }
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>  // std::min
+#include <iterator>  // std::forward_iterator_tag
+#include <span>
+#include <stddef.h>  // size_t, ptrdiff_t
+#include <stdexcept>  // std::invalid_argument
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Strings stored front-coded in one contiguous buffer. Each string is written as the length of the prefix it shares
+// with the string before it, the length of the rest, and the bytes of the rest, with both lengths as LEB128 varints.
+// Strings listed from a trie come out sorted and share long prefixes, so a block is several times smaller than a
+// vector of strings, and it grows one buffer instead of allocating once per string.
+//
+// The buffer is also the wire format. bytes() can be sent as it is, and FrontCodedReader decodes it on the other
+// side straight from the received bytes, without copying them into a block first.
+
+inline void appendVarint(std::vector<char>& bytes, size_t value) {
+    while (value >= 0x80) {
+        bytes.push_back((char) (0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    bytes.push_back((char) value);
+}
+
+// Reads a varint starting at *pos and moves *pos past it. Throws if it runs past end.
+inline size_t readVarint(const char** pos, const char* end) {
+    size_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*pos == end) {
+            break;
+        }
+        uint8_t byte = (uint8_t) *(*pos)++;
+        value |= (size_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::invalid_argument("Malformed front-coded block");
+}
+
+// Decodes front-coded bytes, from a FrontCodedBlock or from the wire. The bytes are not copied, so they must outlive
+// the reader and its iterators. Iterating decodes each string into one buffer that is reused for the next one, so
+// a string returned by an iterator is only valid until the iterator is moved on.
+class FrontCodedReader {
+
+    private:
+        const char* data_;
+        size_t size_;
+
+    public:
+        class Iterator {
+
+            private:
+                const char* pos_;  // Start of the next entry
+                const char* end_;
+                std::string current_;
+                bool done_;
+
+                inline void decodeNext() {
+                    if (pos_ == end_) {
+                        done_ = true;
+                        return;
+                    }
+                    size_t shared = readVarint(&pos_, end_);
+                    size_t suffixLength = readVarint(&pos_, end_);
+                    if (shared > current_.length() || suffixLength > (size_t) (end_ - pos_)) {
+                        throw std::invalid_argument("Malformed front-coded block");
+                    }
+                    current_.resize(shared);
+                    current_.append(pos_, suffixLength);
+                    pos_ += suffixLength;
+                }
+
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = std::string;
+                using difference_type = ptrdiff_t;
+                using pointer = const std::string*;
+                using reference = const std::string&;
+
+                inline Iterator() : pos_(NULL), end_(NULL), done_(true) {}
+
+                inline Iterator(const char* data, size_t size) : pos_(data), end_(data + size), done_(false) {
+                    decodeNext();
+                }
+
+                inline const std::string& operator*() const {
+                    return current_;
+                }
+
+                inline const std::string* operator->() const {
+                    return &current_;
+                }
+
+                inline Iterator& operator++() {
+                    decodeNext();
+                    return *this;
+                }
+
+                inline Iterator operator++(int) {
+                    Iterator old = *this;
+                    decodeNext();
+                    return old;
+                }
+
+                inline bool operator==(const Iterator& other) const {
+                    return done_ == other.done_ && (done_ || pos_ == other.pos_);
+                }
+
+                inline bool operator!=(const Iterator& other) const {
+                    return !(*this == other);
+                }
+        };
+
+        inline FrontCodedReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+        inline FrontCodedReader(std::span<const char> bytes) : data_(bytes.data()), size_(bytes.size()) {}
+
+        inline Iterator begin() const {
+            return Iterator(data_, size_);
+        }
+
+        inline Iterator end() const {
+            return Iterator();
+        }
+};
+
+class FrontCodedBlock {
+
+    private:
+        std::vector<char> bytes_;
+        std::string last_;  // The last string appended, to find the prefix the next one shares with it
+        size_t count_;
+
+    public:
+        inline FrontCodedBlock() : count_(0) {}
+
+        // Appends a string. Any order can be decoded, but strings in sorted order share the most with each other.
+        inline void append(const char* string, size_t length) {
+            size_t limit = std::min(length, last_.length());
+            size_t shared = 0;
+            while (shared < limit && string[shared] == last_[shared]) {
+                shared++;
+            }
+            append(shared, string + shared, length - shared);
+        }
+
+        inline void append(const std::string& string) {
+            append(string.data(), string.length());
+        }
+
+        // Appends the string made of the first shared characters of the last string appended, followed by suffix -
+        // for callers that already know how much the strings share, such as a trie traversal.
+        inline void append(size_t shared, const char* suffix, size_t suffixLength) {
+            if (shared > last_.length()) {
+                throw std::invalid_argument("Shared prefix longer than the last string");
+            }
+            appendVarint(bytes_, shared);
+            appendVarint(bytes_, suffixLength);
+            bytes_.insert(bytes_.end(), suffix, suffix + suffixLength);
+            last_.resize(shared);
+            last_.append(suffix, suffixLength);
+            count_++;
+        }
+
+        // Number of strings
+        inline size_t size() const {
+            return count_;
+        }
+
+        inline bool empty() const {
+            return count_ == 0;
+        }
+
+        // The encoded strings, ready to be sent
+        inline std::span<const char> bytes() const {
+            return std::span<const char>(bytes_.data(), bytes_.size());
+        }
+
+        inline FrontCodedReader::Iterator begin() const {
+            return FrontCodedReader::Iterator(bytes_.data(), bytes_.size());
+        }
+
+        inline FrontCodedReader::Iterator end() const {
+            return FrontCodedReader::Iterator();
+        }
+
+        inline std::vector<std::string> toVector() const {
+            std::vector<std::string> strings;
+            strings.reserve(count_);
+            for (FrontCodedReader::Iterator it = begin(); it != end(); ++it) {
+                strings.push_back(*it);
+            }
+            return strings;
+        }
+};
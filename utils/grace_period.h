@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+
+// Lets a thread wait until every walk that was already running when it started waiting has finished, without
+// making the walks take a shared lock. Walks are counted in one of two phases. wait() moves new walks to the
+// other phase and waits for the count of the old one to drain, so walks that start afterwards do not hold it up.
+class GracePeriod {
+
+    private:
+        std::atomic<long long> counts_[2];  // Number of walks running in each phase
+        std::atomic<int> phase_;  // Phase that new walks are counted in
+        std::mutex waitLock_;  // Only one thread flips the phase at a time
+
+    public:
+        inline GracePeriod() {
+            counts_[0] = 0;
+            counts_[1] = 0;
+            phase_ = 0;
+        }
+
+        // Called when a walk starts. Returns the phase to pass to exit().
+        inline int enter() {
+            while (true) {
+                int phase = phase_.load();
+                counts_[phase]++;
+                if (phase_.load() == phase) {
+                    return phase;
+                }
+                counts_[phase]--;  // The phase was flipped in between, and the waiter may not have seen us
+            }
+        }
+
+        inline void exit(int phase) {
+            counts_[phase]--;
+        }
+
+        // Returns once every walk that entered before the call has exited. Must not be called inside a walk.
+        inline void wait() {
+            std::lock_guard<std::mutex> lock(waitLock_);
+            int old = phase_.load();
+            phase_.store(1 - old);
+            while (counts_[old].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+};
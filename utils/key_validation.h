@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>  // size_t
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_VALIDATION_X86
+#endif
+
+
+// Checks that every byte of a key lies in [lo, hi], 16 or 32 bytes at a time, so that a whole key can be
+// validated before a trie is touched instead of one character at a time during the traversal.
+//
+// x86 only has signed byte comparisons, so bytes and bounds are both shifted by 0x80 first, which turns
+// the unsigned range check into a signed one. The AVX2 kernel is compiled for that target alone and
+// picked at runtime, so the rest of the program does not need to be built with -mavx2.
+
+inline bool keyInRangeScalar(const char* key, size_t begin, size_t length, unsigned char lo, unsigned char hi) {
+    for (size_t i = begin; i < length; i++) {
+        unsigned char c = key[i];
+        if (c < lo || c > hi) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef KEY_VALIDATION_X86
+
+inline bool keyInRangeSSE2(const char* key, size_t length, unsigned char lo, unsigned char hi) {
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    const __m128i loBiased = _mm_set1_epi8((char) (lo ^ 0x80));
+    const __m128i hiBiased = _mm_set1_epi8((char) (hi ^ 0x80));
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (key + i)), bias);
+        __m128i outside = _mm_or_si128(_mm_cmplt_epi8(bytes, loBiased), _mm_cmpgt_epi8(bytes, hiBiased));
+        if (_mm_movemask_epi8(outside)) {
+            return false;
+        }
+    }
+    return keyInRangeScalar(key, i, length, lo, hi);
+}
+
+__attribute__((target("avx2")))
+inline bool keyInRangeAVX2(const char* key, size_t length, unsigned char lo, unsigned char hi) {
+    const __m256i bias = _mm256_set1_epi8((char) 0x80);
+    const __m256i loBiased = _mm256_set1_epi8((char) (lo ^ 0x80));
+    const __m256i hiBiased = _mm256_set1_epi8((char) (hi ^ 0x80));
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*) (key + i)), bias);
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi8(loBiased, bytes), _mm256_cmpgt_epi8(bytes, hiBiased));
+        if (_mm256_movemask_epi8(outside)) {
+            return false;
+        }
+    }
+    return keyInRangeSSE2(key + i, length - i, lo, hi);
+}
+
+#endif
+
+// Returns true if every byte of key[0, length) lies in [lo, hi].
+inline bool isKeyInRange(const char* key, size_t length, unsigned char lo, unsigned char hi) {
+#ifdef KEY_VALIDATION_X86
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (length >= 32 && hasAVX2) {
+        return keyInRangeAVX2(key, length, lo, hi);
+    }
+    return keyInRangeSSE2(key, length, lo, hi);
+#else
+    return keyInRangeScalar(key, 0, length, lo, hi);
+#endif
+}
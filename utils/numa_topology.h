@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>  // std::sort
+#include <dirent.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>  // atoi
+#include <string>
+#include <vector>
+
+
+// A NUMA node and the CPUs that belong to it.
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.length()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.length();
+        }
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+            int first = atoi(range.c_str());
+            int last = (dash == std::string::npos) ? first : atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+// Returns the NUMA nodes that have CPUs, ordered by id, as listed in /sys/devices/system/node.
+// Machines without that information are treated as a single node holding every CPU this process may run on.
+inline std::vector<NumaNode> getNumaNodes() {
+    std::vector<NumaNode> nodes;
+
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.length() == 4 || name[4] < '0' || name[4] > '9') {
+                continue;
+            }
+            std::ifstream cpuList("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            std::getline(cpuList, list);
+            NumaNode node;
+            node.id = atoi(name.c_str() + 4);
+            node.cpus = parseCpuList(list);
+            if (!node.cpus.empty()) {  // Memory-only nodes cannot run a worker
+                nodes.push_back(node);
+            }
+        }
+        closedir(dir);
+    }
+
+    if (nodes.empty()) {
+        NumaNode node;
+        node.id = 0;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+        }
+        nodes.push_back(node);
+    }
+
+    // readdir returns entries in no particular order
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+    return nodes;
+}
+
+// Restricts the calling thread to the given CPUs. Threads it creates afterwards, such as its OpenMP team,
+// inherit the restriction. Returns false if the CPUs could not be set.
+inline bool pinThreadToCpus(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < cpus.size(); i++) {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
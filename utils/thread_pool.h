@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>  // std::function
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+// A fixed number of threads that run the tasks given to them in the order they were submitted.
+// The destructor runs every task already submitted before joining the threads.
+class ThreadPool {
+
+    private:
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;  // Protects the variables below
+        std::condition_variable hasTask_;
+        std::queue<std::function<void()>> tasks_;
+        bool stopping_;
+
+        inline void run() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    while (tasks_.empty() && !stopping_) {
+                        hasTask_.wait(lock);
+                    }
+                    if (tasks_.empty()) {
+                        return;  // Stopping, and every task has been run
+                    }
+                    task = std::move(tasks_.front());
+                    tasks_.pop();
+                }
+                task();
+            }
+        }
+
+    public:
+        inline ThreadPool(int numThreads) {
+            stopping_ = false;
+            for (int i = 0; i < numThreads; i++) {
+                threads_.push_back(std::thread(&ThreadPool::run, this));
+            }
+        }
+
+        inline ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            hasTask_.notify_all();
+            for (int i = 0; i < threads_.size(); i++) {
+                threads_[i].join();
+            }
+        }
+
+        inline void submit(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push(std::move(task));
+            }
+            hasTask_.notify_one();
+        }
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <bitset>
+#include <stdexcept>  // std::invalid_argument
+#include <string>
+#include <vector>
+
+
+// A compiled wildcard pattern that can be matched one character at a time, so that it can be run along the
+// paths of a trie and abandoned as soon as no continuation can match.
+// Supported syntax:
+//   ?        matches any single character
+//   *        matches any sequence of characters, including the empty one
+//   [a-fx]   matches one character from the class; [^...] or [!...] negates it
+//   \c       matches c literally
+class WildcardPattern {
+
+    public:
+        // The set of pattern positions that the characters read so far can be at.
+        typedef std::vector<bool> State;
+
+        inline WildcardPattern(const std::string& pattern) {
+            int i = 0;
+            while (i < pattern.length()) {
+                Token token;
+                char c = pattern[i];
+                if (c == '*') {
+                    token.isStar = true;
+                    i++;
+                } else if (c == '?') {
+                    token.chars.set();
+                    i++;
+                } else if (c == '[') {
+                    i = parseClass(pattern, i + 1, token.chars);
+                } else {
+                    if (c == '\\' && i + 1 < pattern.length()) {
+                        c = pattern[++i];
+                    }
+                    setChar(token.chars, c);
+                    i++;
+                }
+                tokens_.push_back(token);
+            }
+        }
+
+        // State before any character has been read.
+        inline State start() const {
+            State state(tokens_.size() + 1, false);
+            state[0] = true;
+            closeOverStars(state);
+            return state;
+        }
+
+        // State after reading c in the given state.
+        inline State step(const State& state, char c) const {
+            State next(tokens_.size() + 1, false);
+            int idx = (unsigned char) c;
+            for (int p = 0; p < tokens_.size(); p++) {
+                if (!state[p]) {
+                    continue;
+                }
+                if (tokens_[p].isStar) {
+                    next[p] = true;  // * absorbs c and stays put
+                } else if (idx < 256 && tokens_[p].chars.test(idx)) {
+                    next[p + 1] = true;
+                }
+            }
+            closeOverStars(next);
+            return next;
+        }
+
+        // True if the characters read so far form a full match.
+        inline bool accepts(const State& state) const {
+            return state[tokens_.size()];
+        }
+
+        // True if no continuation of the characters read so far can match.
+        inline bool isDead(const State& state) const {
+            for (int p = 0; p < state.size(); p++) {
+                if (state[p]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        struct Token {
+            bool isStar = false;
+            std::bitset<256> chars;  // Characters accepted by a non-star token
+        };
+
+        std::vector<Token> tokens_;
+
+        inline static void setChar(std::bitset<256>& chars, char c) {
+            chars.set((unsigned char) c);
+        }
+
+        // Parses the class starting just after '[' and returns the position just after the closing ']'.
+        inline static int parseClass(const std::string& pattern, int i, std::bitset<256>& chars) {
+            bool negate = false;
+            if (i < pattern.length() && (pattern[i] == '^' || pattern[i] == '!')) {
+                negate = true;
+                i++;
+            }
+            bool first = true;
+            while (i < pattern.length() && (first || pattern[i] != ']')) {
+                first = false;
+                char lo = pattern[i];
+                if (lo == '\\' && i + 1 < pattern.length()) {
+                    lo = pattern[++i];
+                }
+                i++;
+                if (i + 1 < pattern.length() && pattern[i] == '-' && pattern[i + 1] != ']') {
+                    char hi = pattern[i + 1];
+                    if (hi == '\\' && i + 2 < pattern.length()) {
+                        hi = pattern[++i + 1];
+                    }
+                    i += 2;
+                    for (int c = (unsigned char) lo; c <= (unsigned char) hi; c++) {
+                        chars.set(c);
+                    }
+                } else {
+                    setChar(chars, lo);
+                }
+            }
+            if (i >= pattern.length()) {
+                throw std::invalid_argument("Unterminated character class in pattern");
+            }
+            if (negate) {
+                chars.flip();
+            }
+            return i + 1;  // Skip ']'
+        }
+
+        // A position in front of a * can also be past it, since * may match nothing.
+        inline void closeOverStars(State& state) const {
+            for (int p = 0; p < tokens_.size(); p++) {
+                if (state[p] && tokens_[p].isStar) {
+                    state[p + 1] = true;
+                }
+            }
+        }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>  // std::max
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>  // memchr
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "key_validation.h"
+
+
+// A read-only memory mapping of a whole file. The file is not read up front - pages are faulted in
+// as they are touched, and the kernel is told that they will be touched in order.
+class MappedFile {
+
+    private:
+        const char* data_;
+        size_t size_;
+        bool isOpen_;
+
+    public:
+        inline MappedFile(const std::string& filepath) {
+            data_ = NULL;
+            size_ = 0;
+            isOpen_ = false;
+
+            int fd = open(filepath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat info;
+            if (fstat(fd, &info) == 0) {
+                isOpen_ = true;
+                size_ = info.st_size;
+                if (size_ > 0) {  // An empty file cannot be mapped, but is still a valid, empty word list
+                    void* mapping = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (mapping == MAP_FAILED) {
+                        isOpen_ = false;
+                        size_ = 0;
+                    } else {
+                        data_ = (const char*) mapping;
+                        madvise(mapping, size_, MADV_SEQUENTIAL);
+                    }
+                }
+            }
+            close(fd);  // The mapping stays valid after the file is closed
+        }
+
+        inline ~MappedFile() {
+            if (data_) {
+                munmap((void*) data_, size_);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        inline bool isOpen() const { return isOpen_; }
+        inline const char* data() const { return data_; }
+        inline size_t size() const { return size_; }
+};
+
+// Returns the length of the part of data that holds its first numWords lines (all of it if numWords <= 0).
+inline size_t lengthOfLines(const char* data, size_t size, int numWords) {
+    if (numWords <= 0) {
+        return size;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < numWords && pos < size; i++) {
+        const char* newline = (const char*) memchr(data + pos, '\n', size - pos);
+        if (!newline) {
+            return size;
+        }
+        pos = newline - data + 1;
+    }
+    return pos;
+}
+
+// Splits data into numChunks pieces of roughly equal size that each start at the beginning of a line.
+// Returns numChunks + 1 offsets, where chunk k is [offsets[k], offsets[k + 1]).
+inline std::vector<size_t> splitAtLines(const char* data, size_t size, int numChunks) {
+    std::vector<size_t> offsets(numChunks + 1, size);
+    offsets[0] = 0;
+    for (int k = 1; k < numChunks; k++) {
+        size_t pos = std::max(offsets[k - 1], size / numChunks * k);
+        if (pos > 0 && pos < size && data[pos - 1] != '\n') {
+            const char* newline = (const char*) memchr(data + pos, '\n', size - pos);
+            pos = newline ? newline - data + 1 : size;
+        }
+        offsets[k] = pos;
+    }
+    return offsets;
+}
+
+// Calls callback(word, length) for every line in data[begin, end), which must start at the beginning of a line.
+// Line breaks are not included, and a last line without one is still passed on.
+template <typename Callback>
+inline void forEachLine(const char* data, size_t begin, size_t end, Callback callback) {
+    size_t pos = begin;
+    while (pos < end) {
+        const char* newline = (const char*) memchr(data + pos, '\n', end - pos);
+        size_t lineEnd = newline ? newline - data : end;
+        callback(data + pos, lineEnd - pos);
+        pos = lineEnd + 1;
+    }
+}
+
+// Reads up to numWords lines (all of them if numWords <= 0) from the file at filepath, one word per line.
+// Returns an empty list if the file cannot be read.
+inline std::vector<std::string> loadWords(std::string filepath, int numWords) {
+    std::vector<std::string> wordList;
+
+    MappedFile file(filepath);
+    size_t size = lengthOfLines(file.data(), file.size(), numWords);
+    int wordNum = 0;
+    forEachLine(file.data(), 0, size, [&](const char* word, size_t length) {
+        wordNum++;
+        if (!isKeyInRange(word, length, 0, 127)) {
+            printf("Word num %d is invalid\n", wordNum);
+        }
+        wordList.emplace_back(word, length);
+    });
+    return wordList;
+}